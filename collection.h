@@ -0,0 +1,213 @@
+//Shared by the solver and the generator, which both include it after defining WIDTH and HEIGHT
+#ifndef COLLECTION_H
+#define COLLECTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//Where a collection that can't be opened, or a level that isn't in it, gets reported
+#ifndef COLLECTION_ERRORS
+#define COLLECTION_ERRORS stdout
+#endif
+
+//Level collections: a .sok file of many levels is mapped into memory, and a sidecar index (FILE.idx) of where
+//each level's board and title are lets any one level be parsed without reading the rest of the file
+//Titles come from a "Title:" line after the board, or failing that a "; " comment line before it
+#define COLLECTION_INDEX_MAGIC "SOKIDX2"
+
+struct collection_entry {
+	long long board_offset;
+	long long title_offset;
+	int board_length;
+	int title_length;
+};
+
+char* COLLECTION_DATA;
+long long COLLECTION_SIZE;
+long long COLLECTION_MODIFIED; //last write time, so an edit that keeps the size still invalidates the index
+struct collection_entry* COLLECTION_INDEX;
+int COLLECTION_LEVELS;
+
+//modified gets the file's last write time, if it isn't NULL
+char* map_file(char* path, long long* size, long long* modified) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	*size = file_size.QuadPart;
+	FILETIME write_time;
+	GetFileTime(file, NULL, NULL, &write_time);
+	if (modified) *modified = ((long long) write_time.dwHighDateTime << 32) | write_time.dwLowDateTime;
+	if (*size == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) return NULL;
+	char* data = (char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	return data;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return NULL;
+	struct stat info;
+	fstat(file, &info);
+	*size = info.st_size;
+	if (modified) *modified = info.st_mtime;
+	if (*size == 0) {
+		close(file);
+		return NULL;
+	}
+	char* data = (char*) mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED) return NULL;
+	return data;
+#endif
+}
+
+bool is_board_line(char* line, int length) {
+	int i;
+	bool has_wall = false;
+	for (i = 0; i < length; i++) {
+		if (line[i] == '#') has_wall = true;
+		else if (!strchr(" @+$*.-_\r", line[i])) return false;
+	}
+	return has_wall;
+}
+
+void build_collection_index() {
+	int capacity = 1024;
+	COLLECTION_INDEX = (struct collection_entry*) malloc(sizeof(struct collection_entry) * capacity);
+	COLLECTION_LEVELS = 0;
+	bool in_board = false;
+	long long comment_offset = -1; //last "; " comment since the previous board, a fallback title
+	int comment_length = 0;
+	long long position = 0;
+	while (position < COLLECTION_SIZE) {
+		char* line = COLLECTION_DATA + position;
+		long long end = position;
+		while (end < COLLECTION_SIZE && COLLECTION_DATA[end] != '\n') end++;
+		int length = end - position;
+		while (length && line[length-1] == '\r') length--;
+		if (is_board_line(line, length)) {
+			if (!in_board) {
+				if (COLLECTION_LEVELS == capacity) {
+					capacity *= 2;
+					COLLECTION_INDEX = (struct collection_entry*) realloc(COLLECTION_INDEX, sizeof(struct collection_entry) * capacity);
+				}
+				struct collection_entry* entry = &COLLECTION_INDEX[COLLECTION_LEVELS++];
+				entry->board_offset = position;
+				entry->title_offset = comment_offset;
+				entry->title_length = comment_length;
+				comment_offset = -1;
+				comment_length = 0;
+				in_board = true;
+			}
+			COLLECTION_INDEX[COLLECTION_LEVELS-1].board_length = end - COLLECTION_INDEX[COLLECTION_LEVELS-1].board_offset;
+		} else {
+			in_board = false;
+			if (length > 6 && !strncmp(line, "Title:", 6) && COLLECTION_LEVELS) {
+				int skip = 6;
+				while (skip < length && line[skip] == ' ') skip++;
+				COLLECTION_INDEX[COLLECTION_LEVELS-1].title_offset = position + skip;
+				COLLECTION_INDEX[COLLECTION_LEVELS-1].title_length = length - skip;
+			} else if (length > 1 && line[0] == ';') {
+				int skip = 1;
+				while (skip < length && line[skip] == ' ') skip++;
+				comment_offset = position + skip;
+				comment_length = length - skip;
+			}
+		}
+		position = end + 1;
+	}
+}
+
+//Maps the collection, and reads its index, or builds and saves one if it's missing or out of date
+void open_collection(char* path) {
+	COLLECTION_DATA = map_file(path, &COLLECTION_SIZE, &COLLECTION_MODIFIED);
+	if (!COLLECTION_DATA) {
+		fprintf(COLLECTION_ERRORS, "Couldn't map collection %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	char* index_path = (char*) malloc(sizeof(char) * (strlen(path) + 5));
+	sprintf(index_path, "%s.idx", path);
+	char magic[8];
+	long long indexed_size, indexed_modified;
+	FILE* file = fopen(index_path, "rb");
+	if (file) {
+		if (fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, COLLECTION_INDEX_MAGIC, sizeof(magic))
+			&& fread(&indexed_size, sizeof(indexed_size), 1, file) == 1 && indexed_size == COLLECTION_SIZE
+			&& fread(&indexed_modified, sizeof(indexed_modified), 1, file) == 1 && indexed_modified == COLLECTION_MODIFIED
+			&& fread(&COLLECTION_LEVELS, sizeof(COLLECTION_LEVELS), 1, file) == 1) {
+			COLLECTION_INDEX = (struct collection_entry*) malloc(sizeof(struct collection_entry) * (COLLECTION_LEVELS + 1));
+			if (fread(COLLECTION_INDEX, sizeof(struct collection_entry), COLLECTION_LEVELS, file) == (size_t) COLLECTION_LEVELS) {
+				fclose(file);
+				free(index_path);
+				return;
+			}
+			free(COLLECTION_INDEX);
+		}
+		fclose(file);
+	}
+	build_collection_index();
+	file = fopen(index_path, "wb");
+	if (file) {
+		memcpy(magic, COLLECTION_INDEX_MAGIC, sizeof(magic));
+		fwrite(magic, sizeof(magic), 1, file);
+		fwrite(&COLLECTION_SIZE, sizeof(COLLECTION_SIZE), 1, file);
+		fwrite(&COLLECTION_MODIFIED, sizeof(COLLECTION_MODIFIED), 1, file);
+		fwrite(&COLLECTION_LEVELS, sizeof(COLLECTION_LEVELS), 1, file);
+		fwrite(COLLECTION_INDEX, sizeof(struct collection_entry), COLLECTION_LEVELS, file);
+		fclose(file);
+	}
+	free(index_path);
+}
+
+//Returns the index of the level with that number (from 1) or title, or exits if there isn't one
+int find_collection_level(int number, char* title) {
+	int i;
+	if (title) {
+		int title_length = strlen(title);
+		for (i = 0; i < COLLECTION_LEVELS; i++)
+			if (COLLECTION_INDEX[i].title_length == title_length && !memcmp(COLLECTION_DATA + COLLECTION_INDEX[i].title_offset, title, title_length))
+				return i;
+		fprintf(COLLECTION_ERRORS, "No level titled %s\n", title);
+		exit(EXIT_FAILURE);
+	}
+	if (number < 1 || number > COLLECTION_LEVELS) {
+		fprintf(COLLECTION_ERRORS, "No level #%d, the collection has %d\n", number, COLLECTION_LEVELS);
+		exit(EXIT_FAILURE);
+	}
+	return number - 1;
+}
+
+//Measures the board of a collection level, the counterpart of measuring what was read from stdin
+void measure_board(char* board, int length) {
+	int i;
+	int current_row_width = 0;
+	WIDTH = 0;
+	HEIGHT = 0;
+	for (i = 0; i < length; i++) {
+		if (board[i] == '\n') {
+			if (current_row_width > WIDTH) WIDTH = current_row_width;
+			current_row_width = 0;
+			HEIGHT++;
+		} else if (board[i] != '\r') current_row_width++;
+	}
+	if (current_row_width > WIDTH) WIDTH = current_row_width;
+	if (current_row_width) HEIGHT++;
+}
+
+#endif
@@ -1,7 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#endif
 
 #define MAX_LEVEL_SIZE 65536
 
@@ -17,7 +33,7 @@ char* LURD = "LURD";
 
 #define GROWTH_FACTOR (4*N_BOXES)
 
-#define QUEUE_SIZE (65536*256)
+#define QUEUE_SIZE (65536*256) //most states the search may store before it stops
 
 int LEFT;
 int UP;
@@ -42,12 +58,15 @@ int** BOX_PUSHING_DISTANCE_MATRIX; //M[i][j] is minimum # pushes to push a box f
 #define WALL (8)
 #define OG_PLAYER (16)
 
-#define GAMESTATE_HASH_TABLE_SIZE (65536)
+#define GAMESTATE_HASH_TABLE_SIZE (65536*16)
 struct gamestate** GAMESTATE_HASH_TABLE;
+#define GAMESTATE_HASH_LOCKS (4096) //buckets share locks in stripes so threads can insert concurrently
+pthread_mutex_t GAMESTATE_HASH_LOCK[GAMESTATE_HASH_LOCKS];
+int STATES_STORED = 0;
 
 struct gamestate {
 	char* level;
-	int hash;
+	unsigned int hash;
 	struct gamestate* next_in_hash_table;
 	int complexity;
 };
@@ -64,21 +83,26 @@ char* copy_level(char* level) {
 	return copy;
 }
 
-int level_hash(char* level) {
+unsigned int level_hash(char* level) {
 	int i;
-	int h = 0;
-	for (i = 0; i < SIZE; i++) if (level[i] & BOX) h += i*i*i;
+	unsigned int h = 0;
+	for (i = 0; i < SIZE; i++) if (level[i] & BOX) h += (unsigned int) i*i*i;
 	for (i = 0; i < SIZE; i++) if (level[i] & PLAYER) return h + i;
 	printf("Couldn't compute level hash - has no players?\n");
 	exit(EXIT_FAILURE);
 }
 
 //RETURNS NULL IF GAMESTATE ALREADY EXISTS
+//Safe to call from several threads at once
 struct gamestate* make_new_gamestate(char* level, int proposed_complexity) {
-	int hash = level_hash(level);
-	struct gamestate* walker = GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE];
+	unsigned int hash = level_hash(level);
+	unsigned int bucket = hash % GAMESTATE_HASH_TABLE_SIZE;
+	pthread_mutex_t* lock = &GAMESTATE_HASH_LOCK[bucket % GAMESTATE_HASH_LOCKS];
+	pthread_mutex_lock(lock);
+	struct gamestate* walker = GAMESTATE_HASH_TABLE[bucket];
 	while (walker) {
 		if (walker->hash == hash) if (identical_levels(walker->level, level)) {
+			pthread_mutex_unlock(lock);
 			return NULL;
 		}
 		walker = walker->next_in_hash_table;
@@ -86,9 +110,11 @@ struct gamestate* make_new_gamestate(char* level, int proposed_complexity) {
 	struct gamestate* new_node = (struct gamestate*) malloc(sizeof(struct gamestate));
 	new_node->level = level;
 	new_node->hash = hash;
-	new_node->next_in_hash_table = GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE];
+	new_node->next_in_hash_table = GAMESTATE_HASH_TABLE[bucket];
 	new_node->complexity = proposed_complexity;
-	GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE] = new_node;
+	GAMESTATE_HASH_TABLE[bucket] = new_node;
+	pthread_mutex_unlock(lock);
+	__sync_fetch_and_add(&STATES_STORED, 1);
 	return new_node;
 }
 
@@ -150,11 +176,91 @@ void set_player_region(char* level, int player_position) {
 	level[player_position] |= OG_PLAYER;
 }
 
-void find_new_pre_states(struct gamestate** list, struct gamestate* state) {
+void set_directions() {
+	DIRECTIONS[0] = LEFT = -1;
+	DIRECTIONS[1] = UP = -WIDTH;
+	DIRECTIONS[2] = RIGHT = 1;
+	DIRECTIONS[3] = DOWN = WIDTH;
+}
+
+#include "../reachability.h"
+
+//For the parent: is square in region? Only a region that's been labelled is filled in
+bool in_parent_region(struct reachability* reach, int square, int region) {
+	return reach->label_stamp[square] == reach->stamp && reach->label[square] == region;
+}
+
+//Give child the player region marked for it by mark_child_region
+void set_child_region(struct reachability* reach, char* child, int player_position) {
+	int i;
+	for (i = 0; i < SIZE; i++) {
+		child[i] &= ~(PLAYER | OG_PLAYER);
+		if (in_child_region(reach, i)) child[i] |= PLAYER;
+	}
+	child[player_position] |= OG_PLAYER;
+}
+
+//Turns sok text into a template: goals get boxes on them, and other boxes are dropped
+char* parse_template(char* text, int length, int* initial_player_position, int* goals_already_provided) {
+	int i, j = 0;
+	char c;
+	*initial_player_position = -1;
+	*goals_already_provided = 0;
+	char* level_template = (char*) malloc(sizeof(char) * SIZE);
+	for (i = 0; i < SIZE; i++) level_template[i] = 0;
+	for (i = 0; i < SIZE && j < length;) {
+		c = text[j++];
+		if (c == '\n') {
+			while (i%WIDTH) i++;
+			continue;
+		}
+		if (c == '\r') continue;
+		if (c == EOF || c == '\0') break;
+		level_template[i] = sok_to_native(c);
+		if (level_template[i] & PLAYER) *initial_player_position = i;
+		level_template[i] &= ~BOX;
+		if (level_template[i] & GOAL) {
+			(*goals_already_provided)++;
+			level_template[i] |= BOX;
+		}
+		i++;
+	}
+	return level_template;
+}
+
+//Places the player, and boxes on new goals, at random in the player's region of the template
+//Returns NULL if it couldn't find room for everything
+char* spawn_level(char* level_template, char* player_region, int goals_already_provided) {
+	int j;
+	char* level = copy_level(level_template);
+	int things_placed = goals_already_provided;
+	int player_spot = -1;
+	for (j = 0; j < 100 && things_placed < N_BOXES+1; j++) { //j is # attempts at placing things
+		int spot = rand() % SIZE;
+		if (!(player_region[spot] & PLAYER)) continue;
+		if (level[spot]) continue;
+		if (things_placed > goals_already_provided) {
+			level[spot] = BOX | GOAL;
+		} else {
+			level[spot] = PLAYER | OG_PLAYER;
+			player_spot = spot;
+		}
+		things_placed++;
+	}
+	if (things_placed != N_BOXES+1 || player_spot < 0) {
+		free(level);
+		return NULL;
+	}
+	set_player_region(level, player_spot);
+	return level;
+}
+
+void find_new_pre_states(struct reachability* reach, struct gamestate** list, struct gamestate* state) {
 	int i, d, j;
 	char* level = state->level;
 	for (i = 0; i < GROWTH_FACTOR; i++) list[i] = NULL;
 	int entries = 0;
+	begin_reachability(reach);
 	for (i = 0; i < SIZE; i++) if (level[i] & BOX) for (d = 0; d < 4; d++) {
 		int after_box = i + DIRECTIONS[d];
 		int after_after_box = i + 2 * DIRECTIONS[d];
@@ -164,81 +270,1012 @@ void find_new_pre_states(struct gamestate** list, struct gamestate* state) {
 				char* new_level = copy_level(level);
 				new_level[i] &= ~BOX;
 				new_level[after_box] |= BOX;
-				set_player_region(new_level, after_after_box);
+				mark_child_region(reach, level, i, after_box, after_after_box);
+				set_child_region(reach, new_level, after_after_box);
 				struct gamestate* new_state = make_new_gamestate(new_level, state->complexity + 1);
 				if (new_state) list[entries++] = new_state;
+				else free(new_level);
 			}
 	}
 }
 
-int main(int nargs, char** arglist) {
+//Parallel BFS: each layer is cut into chunks that are dealt out to one deque per thread
+//A thread works from the bottom of its own deque, and steals from the top of the others' once it runs dry
+#define BFS_CHUNK_SIZE (64)
+
+struct work_deque {
+	pthread_mutex_t lock;
+	int* chunks; //index in CURRENT_LAYER that each chunk starts at
+	int top;
+	int bottom;
+};
+
+struct bfs_worker {
+	int id;
+	pthread_t thread;
+	struct gamestate** neighbors;
+	struct gamestate** found; //this thread's share of the next layer
+	unsigned short* found_records; //same, for frontier search
+	int found_count;
+	int found_capacity;
+	struct gamestate* most_complex; //most complex state this thread found in the layer
+	char* scratch_level;
+	struct reachability reach;
+};
+
+int N_THREADS;
+struct work_deque* DEQUES;
+struct bfs_worker* WORKERS;
+struct gamestate** CURRENT_LAYER;
+int CURRENT_LAYER_SIZE;
+
+#include "../processors.h"
+
+//Frontier search: only the current and next layers are kept, as compact records rather than boards
+//A record is the seed it came from, its boxes in increasing order, then the lowest square the player can reach
+//Visited records go in a bitset over ranked box placements when it fits, or a hash set of records otherwise
+bool FRONTIER_SEARCH = false;
+FILE* PROGRESS; //stdout, or stderr in batch mode so the levels can go to stdout
+#define RECORD_LENGTH (N_BOXES + 2)
+#define VISITED_BITSET_MAX_BYTES (1ULL << 30)
+#define RECORD_HASH_TABLE_SIZE (65536*64)
+
+char** SEED_LEVELS; //walls and goals of each seed, the only parts of a board a record leaves out
+//Template goals the player can't reach count as floor too, since the box that never leaves one is still in records
+int* FLOOR_INDEX; //index of each square among the squares boxes and the player can be on, or -1
+int N_FLOOR;
+unsigned long long** BINOMIAL;
+unsigned long long PLACEMENTS; //ways to put N_BOXES boxes on the floor
+unsigned long long* VISITED_BITSET;
+
+struct record_node {
+	struct record_node* next;
+	unsigned short record[];
+};
+struct record_node** RECORD_HASH_TABLE;
+
+unsigned short* CURRENT_RECORDS;
+
+void setup_frontier_search(char* floor, int n_seeds) {
+	int i, j;
+	FLOOR_INDEX = (int*) malloc(sizeof(int) * SIZE);
+	N_FLOOR = 0;
+	for (i = 0; i < SIZE; i++) FLOOR_INDEX[i] = (floor[i] & (PLAYER | GOAL)) ? N_FLOOR++ : -1;
+	BINOMIAL = (unsigned long long**) malloc(sizeof(unsigned long long*) * (N_FLOOR + 1));
+	for (i = 0; i <= N_FLOOR; i++) {
+		BINOMIAL[i] = (unsigned long long*) malloc(sizeof(unsigned long long) * (N_BOXES + 1));
+		for (j = 0; j <= N_BOXES; j++) {
+			if (j == 0) BINOMIAL[i][j] = 1;
+			else if (i == 0) BINOMIAL[i][j] = 0;
+			else BINOMIAL[i][j] = BINOMIAL[i-1][j-1] + BINOMIAL[i-1][j];
+			if (BINOMIAL[i][j] > ULLONG_MAX / 2) BINOMIAL[i][j] = ULLONG_MAX / 2; //saturate, only has to tell us it's too big
+		}
+	}
+	PLACEMENTS = BINOMIAL[N_FLOOR][N_BOXES];
+	unsigned long long bytes_per_seed = (PLACEMENTS / 8 + 1) * N_FLOOR;
+	VISITED_BITSET = NULL;
+	RECORD_HASH_TABLE = NULL;
+	if (bytes_per_seed < VISITED_BITSET_MAX_BYTES / n_seeds) {
+		unsigned long long words = (PLACEMENTS * N_FLOOR * n_seeds) / 64 + 1;
+		VISITED_BITSET = (unsigned long long*) calloc(words, sizeof(unsigned long long));
+	}
+	if (VISITED_BITSET) fprintf(PROGRESS, "Frontier search with a %llu byte visited bitset\n", ((PLACEMENTS * N_FLOOR * n_seeds) / 64 + 1) * 8);
+	else {
+		fprintf(PROGRESS, "Frontier search with a visited hash set, too many placements for a bitset\n");
+		RECORD_HASH_TABLE = (struct record_node**) calloc(RECORD_HASH_TABLE_SIZE, sizeof(struct record_node*));
+	}
+}
+
+void pack_record(unsigned short* record, int seed, char* level) {
+	int i, j = 1;
+	record[0] = seed;
+	for (i = 0; i < SIZE; i++) if (level[i] & BOX) record[j++] = i;
+	for (i = 0; i < SIZE; i++) if (level[i] & PLAYER) {
+		record[j] = i;
+		return;
+	}
+}
+
+void unpack_record(char* level, unsigned short* record) {
+	int i;
+	char* seed_level = SEED_LEVELS[record[0]];
+	for (i = 0; i < SIZE; i++) level[i] = seed_level[i];
+	for (i = 1; i <= N_BOXES; i++) level[record[i]] |= BOX;
+	set_player_region(level, record[N_BOXES + 1]);
+}
+
+//Returns true if the record hadn't been visited before, marking it visited. Safe to call from several threads at once
+bool mark_visited(unsigned short* record) {
+	int i;
+	if (VISITED_BITSET) {
+		unsigned long long rank = 0;
+		for (i = 0; i < N_BOXES; i++) rank += BINOMIAL[FLOOR_INDEX[record[i + 1]]][i + 1];
+		unsigned long long bit = ((record[0] * PLACEMENTS) + rank) * N_FLOOR + FLOOR_INDEX[record[N_BOXES + 1]];
+		unsigned long long mask = 1ULL << (bit % 64);
+		return !(__sync_fetch_and_or(&VISITED_BITSET[bit / 64], mask) & mask);
+	}
+	unsigned int hash = 2166136261u;
+	for (i = 0; i < RECORD_LENGTH; i++) hash = (hash ^ record[i]) * 16777619u;
+	unsigned int bucket = hash % RECORD_HASH_TABLE_SIZE;
+	pthread_mutex_t* lock = &GAMESTATE_HASH_LOCK[bucket % GAMESTATE_HASH_LOCKS];
+	pthread_mutex_lock(lock);
+	struct record_node* walker;
+	for (walker = RECORD_HASH_TABLE[bucket]; walker; walker = walker->next)
+		if (!memcmp(walker->record, record, sizeof(unsigned short) * RECORD_LENGTH)) {
+			pthread_mutex_unlock(lock);
+			return false;
+		}
+	struct record_node* new_node = (struct record_node*) malloc(sizeof(struct record_node) + sizeof(unsigned short) * RECORD_LENGTH);
+	memcpy(new_node->record, record, sizeof(unsigned short) * RECORD_LENGTH);
+	new_node->next = RECORD_HASH_TABLE[bucket];
+	RECORD_HASH_TABLE[bucket] = new_node;
+	pthread_mutex_unlock(lock);
+	__sync_fetch_and_add(&STATES_STORED, 1);
+	return true;
+}
+
+//Seeds are the gamestates in CURRENT_LAYER, seed i becomes record i
+void records_from_seeds() {
 	int i, j;
+	SEED_LEVELS = (char**) malloc(sizeof(char*) * CURRENT_LAYER_SIZE);
+	CURRENT_RECORDS = (unsigned short*) malloc(sizeof(unsigned short) * RECORD_LENGTH * CURRENT_LAYER_SIZE);
+	for (i = 0; i < CURRENT_LAYER_SIZE; i++) {
+		SEED_LEVELS[i] = copy_level(CURRENT_LAYER[i]->level);
+		for (j = 0; j < SIZE; j++) SEED_LEVELS[i][j] &= (WALL | GOAL);
+		pack_record(&CURRENT_RECORDS[i * RECORD_LENGTH], i, CURRENT_LAYER[i]->level);
+		mark_visited(&CURRENT_RECORDS[i * RECORD_LENGTH]);
+	}
+}
+
+//Batch mode: every seed of every template is searched at once, and each seed's deepest board is streamed out as a level
+//Levels already written, by this run or an earlier one, are skipped using fingerprints kept in an index file
+bool BATCH_MODE = false;
+FILE* BATCH_OUTPUT;
+FILE* FINGERPRINT_FILE;
+unsigned long long* FINGERPRINTS; //open addressing, 0 marks an empty slot
+int FINGERPRINT_CAPACITY;
+int N_FINGERPRINTS;
+int N_SEEDS;
+int* SEED_TEMPLATE;
+unsigned int* SEED_VALUE;
+int* SEED_STATES; //states explored from each seed
+int* SEED_DEPTH;
+unsigned short* SEED_DEEPEST; //deepest record found from each seed
+bool* SEED_ALIVE; //whether the seed still has records in the current layer
+int* TEMPLATE_WIDTH;
+int* TEMPLATE_HEIGHT;
+int LEVELS_WRITTEN = 0;
+int DUPLICATES_SKIPPED = 0;
+
+//Returns false if the fingerprint was already there
+bool add_fingerprint(unsigned long long fingerprint) {
+	int i;
+	if (!fingerprint) fingerprint = 1;
+	if (2 * (N_FINGERPRINTS + 1) > FINGERPRINT_CAPACITY) {
+		unsigned long long* old_fingerprints = FINGERPRINTS;
+		int old_capacity = FINGERPRINT_CAPACITY;
+		FINGERPRINT_CAPACITY = old_capacity ? old_capacity * 2 : 1024;
+		FINGERPRINTS = (unsigned long long*) calloc(FINGERPRINT_CAPACITY, sizeof(unsigned long long));
+		N_FINGERPRINTS = 0;
+		for (i = 0; i < old_capacity; i++) if (old_fingerprints[i]) add_fingerprint(old_fingerprints[i]);
+		free(old_fingerprints);
+	}
+	int slot = fingerprint % FINGERPRINT_CAPACITY;
+	while (FINGERPRINTS[slot]) {
+		if (FINGERPRINTS[slot] == fingerprint) return false;
+		slot = (slot + 1) % FINGERPRINT_CAPACITY;
+	}
+	FINGERPRINTS[slot] = fingerprint;
+	N_FINGERPRINTS++;
+	return true;
+}
+
+//The index file is just the fingerprints of every level written so far, 8 bytes each
+void load_fingerprints(char* index_path) {
+	FINGERPRINTS = NULL;
+	FINGERPRINT_CAPACITY = 0;
+	N_FINGERPRINTS = 0;
+	FINGERPRINT_FILE = NULL;
+	if (!index_path) return;
+	FILE* file = fopen(index_path, "rb");
+	if (file) {
+		unsigned long long fingerprint;
+		while (fread(&fingerprint, sizeof(fingerprint), 1, file) == 1) add_fingerprint(fingerprint);
+		fclose(file);
+	}
+	FINGERPRINT_FILE = fopen(index_path, "ab");
+	if (!FINGERPRINT_FILE) {
+		fprintf(PROGRESS, "Couldn't open fingerprint index %s\n", index_path);
+		exit(EXIT_FAILURE);
+	}
+	fprintf(PROGRESS, "Loaded %d fingerprints\n", N_FINGERPRINTS);
+}
+
+//A finished level, waiting to be written (and, in a pipeline, to be solved first)
+struct candidate {
+	char* text; //board rows, no metadata
+	unsigned long long fingerprint;
+	int template_index;
+	unsigned int seed;
+	int depth;
+	int states;
+	bool verified;
+	unsigned long long expansions;
+	int pushes;
+	int moves;
+	int milliseconds;
+	bool timed_out;
+	struct candidate* next;
+};
+
+void write_candidate(struct candidate* level) {
+	if (FINGERPRINT_FILE) {
+		fwrite(&level->fingerprint, sizeof(level->fingerprint), 1, FINGERPRINT_FILE);
+		fflush(FINGERPRINT_FILE);
+	}
+	fprintf(BATCH_OUTPUT, "%sTitle: Template %d, seed %u\n", level->text, level->template_index + 1, level->seed);
+	fprintf(BATCH_OUTPUT, "Comment: depth %d, %d states explored, seed %u\n", level->depth, level->states, level->seed);
+	if (level->verified) fprintf(BATCH_OUTPUT, "Comment: solver expanded %llu states, %d pushes, %d moves, %d ms\n", level->expansions, level->pushes, level->moves, level->milliseconds);
+	fprintf(BATCH_OUTPUT, "\n");
+	fflush(BATCH_OUTPUT);
+	LEVELS_WRITTEN++;
+}
+
+//Generate-then-verify pipeline: finished levels are queued for a pool of solver threads, each running the solver
+//as a separate process, while the search carries on. Only the TOP_K that cost the solver the most are kept
+char* SOLVER_PATH = NULL;
+int N_SOLVERS;
+int TOP_K;
+pthread_t* SOLVER_THREADS;
+struct candidate* CANDIDATE_QUEUE_HEAD = NULL;
+struct candidate* CANDIDATE_QUEUE_TAIL = NULL;
+bool GENERATION_DONE = false;
+pthread_mutex_t CANDIDATE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t CANDIDATE_READY = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t SPAWN_LOCK = PTHREAD_MUTEX_INITIALIZER; //held while a solver is started, so no other solver inherits its pipe
+struct candidate** TOP_CANDIDATES;
+int N_TOP_CANDIDATES = 0;
+int CANDIDATES_SOLVED = 0;
+int CANDIDATES_TIMED_OUT = 0;
+int SOLVER_TIMEOUT; //seconds before a solver is killed and its candidate rejected
+unsigned int PIPELINE_ID; //process id, keeps temporary files of runs sharing a directory apart
+
+void free_candidate(struct candidate* level) {
+	free(level->text);
+	free(level);
+}
+
+//Higher is harder: solver effort first, then solution length, then time
+bool harder_than(struct candidate* a, struct candidate* b) {
+	if (a->expansions != b->expansions) return a->expansions > b->expansions;
+	if (a->pushes != b->pushes) return a->pushes > b->pushes;
+	return a->milliseconds > b->milliseconds;
+}
+
+void queue_candidate(struct candidate* level) {
+	pthread_mutex_lock(&CANDIDATE_LOCK);
+	level->next = NULL;
+	if (CANDIDATE_QUEUE_TAIL) CANDIDATE_QUEUE_TAIL->next = level;
+	else CANDIDATE_QUEUE_HEAD = level;
+	CANDIDATE_QUEUE_TAIL = level;
+	pthread_cond_signal(&CANDIDATE_READY);
+	pthread_mutex_unlock(&CANDIDATE_LOCK);
+}
+
+//Runs the solver on the level and reads its stats back, returns false if it didn't solve it
+void read_solver_line(struct candidate* level, char* line) {
+	int i = 0, pushes = 0;
+	while (line[i] && strchr("lurdLURD", line[i])) {
+		if (line[i] >= 'A' && line[i] <= 'Z') pushes++;
+		i++;
+	}
+	if (i > 0 && (line[i] == '\n' || line[i] == '\r' || line[i] == '\0')) {
+		level->moves = i;
+		level->pushes = pushes;
+	}
+	if (sscanf(line, "%llu expansions, %*d states stored, %d ms", &level->expansions, &level->milliseconds) == 2) level->verified = true;
+}
+
+bool solve_candidate(struct candidate* level, int solver_id) {
+	char path[64];
+	snprintf(path, sizeof(path), "gen_candidate_%u_%d.sok", PIPELINE_ID, solver_id);
+	FILE* file = fopen(path, "w");
+	if (!file) return false;
+	fputs(level->text, file);
+	fclose(file);
+	level->verified = level->timed_out = false;
+	level->pushes = level->moves = 0;
+	int capacity = 4096, length = 0;
+	char* output;
+#ifdef _WIN32
+	//The solver gets SOLVER_TIMEOUT seconds of wall clock, then its job, which takes anything it started too, is ended
+	//A process takes every inheritable handle there is when it's made, so no other solver thread may make one
+	//while this solver's handles are still open here
+	SECURITY_ATTRIBUTES inheritable = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+	HANDLE read_end, write_end;
+	STARTUPINFOA startup;
+	PROCESS_INFORMATION process;
+	char command[1024];
+	snprintf(command, sizeof(command), "\"%s\"", SOLVER_PATH);
+	pthread_mutex_lock(&SPAWN_LOCK);
+	HANDLE input = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, &inheritable, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (input == INVALID_HANDLE_VALUE || !CreatePipe(&read_end, &write_end, &inheritable, 0)) {
+		if (input != INVALID_HANDLE_VALUE) CloseHandle(input);
+		pthread_mutex_unlock(&SPAWN_LOCK);
+		remove(path);
+		return false;
+	}
+	SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0);
+	ZeroMemory(&startup, sizeof(startup));
+	startup.cb = sizeof(startup);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = input;
+	startup.hStdOutput = write_end;
+	startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	bool started = CreateProcessA(NULL, command, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &startup, &process);
+	CloseHandle(input);
+	CloseHandle(write_end);
+	pthread_mutex_unlock(&SPAWN_LOCK);
+	if (!started) {
+		CloseHandle(read_end);
+		remove(path);
+		return false;
+	}
+	HANDLE job = CreateJobObjectA(NULL, NULL);
+	if (job) AssignProcessToJobObject(job, process.hProcess);
+	ResumeThread(process.hThread);
+	CloseHandle(process.hThread);
+	output = (char*) malloc(capacity);
+	ULONGLONG deadline = GetTickCount64() + (ULONGLONG) SOLVER_TIMEOUT * 1000;
+	bool exited = false;
+	while (true) {
+		//Same as below: once the solver has exited, an empty pipe means everything it wrote has been read
+		DWORD available = 0;
+		if (!PeekNamedPipe(read_end, NULL, 0, NULL, &available, NULL)) break; //every write end is closed
+		if (available) {
+			if (length + 1 >= capacity) {
+				capacity *= 2;
+				output = (char*) realloc(output, capacity);
+			}
+			DWORD got = 0;
+			DWORD room = capacity - length - 1;
+			if (!ReadFile(read_end, output + length, (available < room) ? available : room, &got, NULL) || !got) break;
+			length += got;
+			continue;
+		}
+		if (exited) break;
+		if (GetTickCount64() >= deadline) {
+			level->timed_out = true;
+			break;
+		}
+		if (WaitForSingleObject(process.hProcess, 50) == WAIT_OBJECT_0) exited = true;
+	}
+	CloseHandle(read_end);
+	if (level->timed_out) {
+		if (job) TerminateJobObject(job, 1);
+		else TerminateProcess(process.hProcess, 1);
+		WaitForSingleObject(process.hProcess, INFINITE);
+	}
+	CloseHandle(process.hProcess);
+	if (job) CloseHandle(job);
+#else
+	//The solver gets SOLVER_TIMEOUT seconds of wall clock, then it's killed
+	//Other solver threads fork too, and their solvers mustn't hold this pipe open, so none of them
+	//may fork between the pipe being made and it being marked close-on-exec
+	int pipe_ends[2];
+	pthread_mutex_lock(&SPAWN_LOCK);
+	if (pipe(pipe_ends)) {
+		pthread_mutex_unlock(&SPAWN_LOCK);
+		remove(path);
+		return false;
+	}
+	fcntl(pipe_ends[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipe_ends[1], F_SETFD, FD_CLOEXEC);
+	pid_t pid = fork();
+	if (pid != 0) pthread_mutex_unlock(&SPAWN_LOCK);
+	if (pid == 0) {
+		setpgid(0, 0); //its own process group, so a kill takes anything it started too
+		int input = open(path, O_RDONLY);
+		if (input < 0) _exit(127);
+		dup2(input, STDIN_FILENO);
+		dup2(pipe_ends[1], STDOUT_FILENO);
+		close(input);
+		close(pipe_ends[0]);
+		close(pipe_ends[1]);
+		execlp(SOLVER_PATH, SOLVER_PATH, (char*) NULL);
+		_exit(127);
+	}
+	close(pipe_ends[1]);
+	if (pid < 0) {
+		close(pipe_ends[0]);
+		remove(path);
+		return false;
+	}
+	output = (char*) malloc(capacity);
+	time_t deadline = time(NULL) + SOLVER_TIMEOUT;
+	bool exited = false;
+	while (true) {
+		//Once the solver has exited, everything it wrote is already in the pipe, so an empty pipe means it's
+		//all been read, even if some other process still holds the write end and keeps EOF from coming
+		if (!exited && waitpid(pid, NULL, WNOHANG) == pid) exited = true;
+		time_t now = time(NULL);
+		if (!exited && now >= deadline) {
+			level->timed_out = true;
+			break;
+		}
+		fd_set ready;
+		FD_ZERO(&ready);
+		FD_SET(pipe_ends[0], &ready);
+		struct timeval wait = {exited ? 0 : 1, 0}; //checks on the solver every second
+		if (select(pipe_ends[0] + 1, &ready, NULL, NULL, &wait) <= 0) {
+			if (exited) break;
+			continue;
+		}
+		if (length + 1 >= capacity) {
+			capacity *= 2;
+			output = (char*) realloc(output, capacity);
+		}
+		int got = read(pipe_ends[0], output + length, capacity - length - 1);
+		if (got <= 0) break;
+		length += got;
+	}
+	close(pipe_ends[0]);
+	if (level->timed_out) kill(-pid, SIGKILL);
+	if (!exited) waitpid(pid, NULL, 0);
+#endif
+	output[length] = '\0';
+	char* line = output;
+	while (*line && !level->timed_out) {
+		char* line_end = strchr(line, '\n');
+		if (line_end) *line_end = '\0';
+		read_solver_line(level, line);
+		if (!line_end) break;
+		line = line_end + 1;
+	}
+	free(output);
+	remove(path);
+	return !level->timed_out && level->verified && level->moves > 0;
+}
+void keep_if_top(struct candidate* level) {
+	int i;
+	pthread_mutex_lock(&CANDIDATE_LOCK);
+	CANDIDATES_SOLVED++;
+	if (N_TOP_CANDIDATES == TOP_K) {
+		if (!harder_than(level, TOP_CANDIDATES[N_TOP_CANDIDATES-1])) {
+			pthread_mutex_unlock(&CANDIDATE_LOCK);
+			free_candidate(level);
+			return;
+		}
+		free_candidate(TOP_CANDIDATES[--N_TOP_CANDIDATES]);
+	}
+	//TOP_CANDIDATES stays sorted, hardest first
+	for (i = N_TOP_CANDIDATES; i > 0 && harder_than(level, TOP_CANDIDATES[i-1]); i--) TOP_CANDIDATES[i] = TOP_CANDIDATES[i-1];
+	TOP_CANDIDATES[i] = level;
+	N_TOP_CANDIDATES++;
+	pthread_mutex_unlock(&CANDIDATE_LOCK);
+}
+void* run_solver(void* argument) {
+	int solver_id = (int) (long) argument;
+	while (true) {
+		pthread_mutex_lock(&CANDIDATE_LOCK);
+		while (!CANDIDATE_QUEUE_HEAD && !GENERATION_DONE) pthread_cond_wait(&CANDIDATE_READY, &CANDIDATE_LOCK);
+		struct candidate* level = CANDIDATE_QUEUE_HEAD;
+		if (level) {
+			CANDIDATE_QUEUE_HEAD = level->next;
+			if (!CANDIDATE_QUEUE_HEAD) CANDIDATE_QUEUE_TAIL = NULL;
+		}
+		pthread_mutex_unlock(&CANDIDATE_LOCK);
+		if (!level) return NULL; //generation is over and the queue is drained
+		if (solve_candidate(level, solver_id)) keep_if_top(level);
+		else if (level->timed_out) {
+			fprintf(PROGRESS, "Solver timed out on template %d, seed %u, rejecting it\n", level->template_index + 1, level->seed);
+			__sync_fetch_and_add(&CANDIDATES_TIMED_OUT, 1);
+			free_candidate(level);
+		} else {
+			fprintf(PROGRESS, "Solver failed on template %d, seed %u\n", level->template_index + 1, level->seed);
+			free_candidate(level);
+		}
+	}
+}
+
+void start_solvers() {
+	long i;
+	TOP_CANDIDATES = (struct candidate**) malloc(sizeof(struct candidate*) * TOP_K);
+	SOLVER_THREADS = (pthread_t*) malloc(sizeof(pthread_t) * N_SOLVERS);
+	for (i = 0; i < N_SOLVERS; i++) pthread_create(&SOLVER_THREADS[i], NULL, run_solver, (void*) i);
+}
+
+//Waits for the solvers to drain the queue, then writes the levels that were kept
+void finish_solvers() {
+	int i;
+	pthread_mutex_lock(&CANDIDATE_LOCK);
+	GENERATION_DONE = true;
+	pthread_cond_broadcast(&CANDIDATE_READY);
+	pthread_mutex_unlock(&CANDIDATE_LOCK);
+	for (i = 0; i < N_SOLVERS; i++) pthread_join(SOLVER_THREADS[i], NULL);
+	fprintf(PROGRESS, "Solved %d candidates (%d timed out), keeping the %d hardest\n", CANDIDATES_SOLVED, CANDIDATES_TIMED_OUT, N_TOP_CANDIDATES);
+	for (i = 0; i < N_TOP_CANDIDATES; i++) write_candidate(TOP_CANDIDATES[i]);
+}
+
+void write_batch_level(int seed) {
+	int x, y;
+	int t = SEED_TEMPLATE[seed];
+	if (SEED_DEPTH[seed] == 0) return; //no pulls at all, so it's already solved
+	char* level = (char*) malloc(sizeof(char) * SIZE);
+	unpack_record(level, &SEED_DEEPEST[seed * RECORD_LENGTH]);
+	char* text = (char*) malloc(sizeof(char) * ((TEMPLATE_WIDTH[t] + 1) * TEMPLATE_HEIGHT[t] + 1));
+	int length = 0;
+	for (y = 0; y < TEMPLATE_HEIGHT[t]; y++) {
+		for (x = 0; x < TEMPLATE_WIDTH[t]; x++) text[length++] = native_to_sok(level[y*WIDTH+x]);
+		while (length && text[length-1] == ' ') length--;
+		text[length++] = '\n';
+	}
+	text[length] = '\0';
+	free(level);
+	unsigned long long fingerprint = 14695981039346656037ULL;
+	for (x = 0; x < length; x++) fingerprint = (fingerprint ^ (unsigned char) text[x]) * 1099511628211ULL;
+	if (!add_fingerprint(fingerprint)) {
+		DUPLICATES_SKIPPED++;
+		free(text);
+		return;
+	}
+	struct candidate* candidate = (struct candidate*) malloc(sizeof(struct candidate));
+	candidate->text = text;
+	candidate->fingerprint = fingerprint;
+	candidate->template_index = t;
+	candidate->seed = SEED_VALUE[seed];
+	candidate->depth = SEED_DEPTH[seed];
+	candidate->states = SEED_STATES[seed];
+	candidate->verified = false;
+	if (SOLVER_PATH) queue_candidate(candidate);
+	else {
+		write_candidate(candidate);
+		free_candidate(candidate);
+	}
+}
+
+//Called with each new layer. Seeds that had records in the last layer but none in this one are done
+void update_batch_seeds(unsigned short* records, int count, int depth) {
+	int i;
+	bool* seen = (bool*) calloc(N_SEEDS, sizeof(bool));
+	for (i = 0; i < count; i++) {
+		unsigned short* record = &records[i * RECORD_LENGTH];
+		unsigned short* deepest = &SEED_DEEPEST[record[0] * RECORD_LENGTH];
+		if (seen[record[0]]) {
+			//Keep the lowest record, so the level doesn't depend on how the threads split the layer
+			int k = 1;
+			while (k < RECORD_LENGTH && record[k] == deepest[k]) k++;
+			if (k == RECORD_LENGTH || record[k] > deepest[k]) continue;
+		}
+		seen[record[0]] = true;
+		SEED_DEPTH[record[0]] = depth;
+		memcpy(deepest, record, sizeof(unsigned short) * RECORD_LENGTH);
+	}
+	for (i = 0; i < N_SEEDS; i++) {
+		if (SEED_ALIVE[i] && !seen[i]) write_batch_level(i);
+		SEED_ALIVE[i] = seen[i];
+	}
+	free(seen);
+}
+
+//Frontier counterpart of find_new_pre_states, adds every unvisited pull to the worker's next layer
+void expand_record(struct bfs_worker* worker, unsigned short* record) {
+	int i, d, j, k;
+	char* level = worker->scratch_level;
+	struct reachability* reach = &worker->reach;
+	//the parent's player region comes from the labels, so the board only needs its boxes
+	memcpy(level, SEED_LEVELS[record[0]], SIZE);
+	for (k = 1; k <= N_BOXES; k++) level[record[k]] |= BOX;
+	begin_reachability(reach);
+	int player_region = region_of(reach, level, record[N_BOXES + 1]);
+	for (k = 1; k <= N_BOXES; k++) for (d = 0; d < 4; d++) {
+		i = record[k];
+		int after_box = i + DIRECTIONS[d];
+		int after_after_box = i + 2 * DIRECTIONS[d];
+		if (!in_parent_region(reach, after_box, player_region)) continue;
+		if (level[after_after_box] & (WALL | BOX)) continue;
+		if (worker->found_count >= worker->found_capacity) {
+			worker->found_capacity *= 2;
+			worker->found_records = (unsigned short*) realloc(worker->found_records, sizeof(unsigned short) * RECORD_LENGTH * worker->found_capacity);
+		}
+		//same as pack_record on the child: boxes stay sorted, and the player is the lowest square it can reach
+		unsigned short* new_record = &worker->found_records[worker->found_count * RECORD_LENGTH];
+		int n = 1;
+		bool placed = false;
+		new_record[0] = record[0];
+		for (j = 1; j <= N_BOXES; j++) {
+			if (j == k) continue;
+			if (!placed && after_box < record[j]) {
+				new_record[n++] = after_box;
+				placed = true;
+			}
+			new_record[n++] = record[j];
+		}
+		if (!placed) new_record[n++] = after_box;
+		new_record[n] = mark_child_region(reach, level, i, after_box, after_after_box);
+		if (mark_visited(new_record)) {
+			worker->found_count++;
+			if (BATCH_MODE) __sync_fetch_and_add(&SEED_STATES[record[0]], 1);
+		}
+	}
+}
+
+void setup_workers() {
+	int t;
+	DEQUES = (struct work_deque*) malloc(sizeof(struct work_deque) * N_THREADS);
+	WORKERS = (struct bfs_worker*) malloc(sizeof(struct bfs_worker) * N_THREADS);
+	for (t = 0; t < N_THREADS; t++) {
+		pthread_mutex_init(&DEQUES[t].lock, NULL);
+		DEQUES[t].chunks = NULL;
+		WORKERS[t].id = t;
+		WORKERS[t].neighbors = (struct gamestate**) malloc(sizeof(struct gamestate*) * GROWTH_FACTOR);
+		WORKERS[t].found_capacity = 1024;
+		WORKERS[t].found = (struct gamestate**) malloc(sizeof(struct gamestate*) * WORKERS[t].found_capacity);
+		WORKERS[t].found_records = (unsigned short*) malloc(sizeof(unsigned short) * RECORD_LENGTH * WORKERS[t].found_capacity);
+		WORKERS[t].scratch_level = (char*) malloc(sizeof(char) * SIZE);
+		setup_reachability(&WORKERS[t].reach);
+	}
+}
+
+bool take_chunk(int thread, int* chunk_start) {
+	struct work_deque* deque = &DEQUES[thread];
+	pthread_mutex_lock(&deque->lock);
+	if (deque->top < deque->bottom) {
+		*chunk_start = deque->chunks[--deque->bottom];
+		pthread_mutex_unlock(&deque->lock);
+		return true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	int k;
+	for (k = 1; k < N_THREADS; k++) {
+		deque = &DEQUES[(thread + k) % N_THREADS];
+		pthread_mutex_lock(&deque->lock);
+		if (deque->top < deque->bottom) {
+			*chunk_start = deque->chunks[deque->top++];
+			pthread_mutex_unlock(&deque->lock);
+			return true;
+		}
+		pthread_mutex_unlock(&deque->lock);
+	}
+	return false; //nothing is added mid-layer, so every deque being empty means the layer is done
+}
+
+void expand_gamestate(struct bfs_worker* worker, struct gamestate* state) {
+	int j;
+	find_new_pre_states(&worker->reach, worker->neighbors, state);
+	for (j = 0; j < GROWTH_FACTOR && worker->neighbors[j]; j++) {
+		if (worker->found_count >= worker->found_capacity) {
+			worker->found_capacity *= 2;
+			worker->found = (struct gamestate**) realloc(worker->found, sizeof(struct gamestate*) * worker->found_capacity);
+		}
+		worker->found[worker->found_count++] = worker->neighbors[j];
+		if (!worker->most_complex || worker->neighbors[j]->complexity > worker->most_complex->complexity)
+			worker->most_complex = worker->neighbors[j];
+	}
+}
+
+void* run_worker(void* argument) {
+	struct bfs_worker* worker = (struct bfs_worker*) argument;
+	int chunk_start, i;
+	while (take_chunk(worker->id, &chunk_start)) {
+		int chunk_end = chunk_start + BFS_CHUNK_SIZE;
+		if (chunk_end > CURRENT_LAYER_SIZE) chunk_end = CURRENT_LAYER_SIZE;
+		for (i = chunk_start; i < chunk_end; i++) {
+			if (FRONTIER_SEARCH) expand_record(worker, &CURRENT_RECORDS[i * RECORD_LENGTH]);
+			else expand_gamestate(worker, CURRENT_LAYER[i]);
+		}
+	}
+	return NULL;
+}
+
+//Expands all of CURRENT_LAYER (or CURRENT_RECORDS), leaving the next layer spread over the workers' found lists
+void expand_layer() {
+	int t, c;
+	int n_chunks = (CURRENT_LAYER_SIZE + BFS_CHUNK_SIZE - 1) / BFS_CHUNK_SIZE;
+	for (t = 0; t < N_THREADS; t++) {
+		free(DEQUES[t].chunks);
+		DEQUES[t].chunks = (int*) malloc(sizeof(int) * (n_chunks / N_THREADS + 1));
+		DEQUES[t].top = DEQUES[t].bottom = 0;
+	}
+	for (c = 0; c < n_chunks; c++) {
+		struct work_deque* deque = &DEQUES[c % N_THREADS];
+		deque->chunks[deque->bottom++] = c * BFS_CHUNK_SIZE;
+	}
+	for (t = 0; t < N_THREADS; t++) {
+		WORKERS[t].found_count = 0;
+		WORKERS[t].most_complex = NULL;
+		pthread_create(&WORKERS[t].thread, NULL, run_worker, &WORKERS[t]);
+	}
+	for (t = 0; t < N_THREADS; t++) pthread_join(WORKERS[t].thread, NULL);
+}
+
+//Layer by layer like the BFS in main, returns the board of the most complex record found
+char* run_frontier_search(bool* queue_full) {
+	int t;
+	int depth = 0;
+	char* most_complex = (char*) malloc(sizeof(char) * SIZE);
+	unpack_record(most_complex, CURRENT_RECORDS);
+	*queue_full = false;
+	while (CURRENT_LAYER_SIZE) {
+		if (!VISITED_BITSET && STATES_STORED >= QUEUE_SIZE) {
+			*queue_full = true;
+			break;
+		}
+		expand_layer();
+		int next_layer_size = 0;
+		for (t = 0; t < N_THREADS; t++) next_layer_size += WORKERS[t].found_count;
+		unsigned short* next_records = (unsigned short*) malloc(sizeof(unsigned short) * RECORD_LENGTH * (next_layer_size + 1));
+		next_layer_size = 0;
+		for (t = 0; t < N_THREADS; t++) {
+			memcpy(&next_records[next_layer_size * RECORD_LENGTH], WORKERS[t].found_records, sizeof(unsigned short) * RECORD_LENGTH * WORKERS[t].found_count);
+			next_layer_size += WORKERS[t].found_count;
+		}
+		if (next_layer_size) {
+			depth++;
+			unpack_record(most_complex, next_records);
+			if (BATCH_MODE) fprintf(PROGRESS, "[%d] %d states\n", depth, next_layer_size);
+			else {
+				printf("[%d]\n", depth);
+				print_level(most_complex);
+			}
+		}
+		if (BATCH_MODE) update_batch_seeds(next_records, next_layer_size, depth);
+		free(CURRENT_RECORDS);
+		CURRENT_RECORDS = next_records;
+		CURRENT_LAYER_SIZE = next_layer_size;
+	}
+	if (BATCH_MODE) update_batch_seeds(CURRENT_RECORDS, 0, depth); //seeds cut off by a full queue
+	return most_complex;
+}
+
+#define COLLECTION_ERRORS PROGRESS
+#include "../collection.h"
+
+//Batch mode's counterpart to main: templates are every level of a collection, or read from stdin,
+//separated by any lines without walls in them
+void run_batch(int spawn_group_size, unsigned int base_seed, char* output_path, char* index_path, char* collection_path) {
+	int i, t, c;
 	
+	int template_capacity = 16;
+	int n_templates = 0;
+	char** template_text = (char**) malloc(sizeof(char*) * template_capacity);
+	int* template_length = (int*) malloc(sizeof(int) * template_capacity);
+	TEMPLATE_WIDTH = (int*) malloc(sizeof(int) * template_capacity);
+	TEMPLATE_HEIGHT = (int*) malloc(sizeof(int) * template_capacity);
+	if (collection_path) {
+		open_collection(collection_path);
+		n_templates = COLLECTION_LEVELS;
+		template_text = (char**) realloc(template_text, sizeof(char*) * (n_templates + 1));
+		template_length = (int*) realloc(template_length, sizeof(int) * (n_templates + 1));
+		TEMPLATE_WIDTH = (int*) realloc(TEMPLATE_WIDTH, sizeof(int) * (n_templates + 1));
+		TEMPLATE_HEIGHT = (int*) realloc(TEMPLATE_HEIGHT, sizeof(int) * (n_templates + 1));
+		for (t = 0; t < n_templates; t++) {
+			template_text[t] = COLLECTION_DATA + COLLECTION_INDEX[t].board_offset;
+			template_length[t] = COLLECTION_INDEX[t].board_length;
+			measure_board(template_text[t], template_length[t]);
+			TEMPLATE_WIDTH[t] = WIDTH;
+			TEMPLATE_HEIGHT[t] = HEIGHT;
+		}
+	} else {
+		int length = 0;
+		int capacity = MAX_LEVEL_SIZE;
+		char* input = (char*) malloc(sizeof(char) * capacity);
+		while ((c = getchar()) != EOF) {
+			if (length + 2 >= capacity) {
+				capacity *= 2;
+				input = (char*) realloc(input, sizeof(char) * capacity);
+			}
+			input[length++] = c;
+		}
+		input[length] = '\0';
+		
+		//Split into templates, each one running from its first board line to the end of its last
+		bool in_template = false;
+		char* line = input;
+		while (true) {
+			char* line_end = line;
+			while (*line_end && *line_end != '\n') line_end++;
+			bool has_wall = false;
+			char* walker;
+			for (walker = line; walker < line_end; walker++) if (*walker == '#') has_wall = true;
+			if (has_wall) {
+				if (!in_template) {
+					if (n_templates == template_capacity) {
+						template_capacity *= 2;
+						template_text = (char**) realloc(template_text, sizeof(char*) * template_capacity);
+						template_length = (int*) realloc(template_length, sizeof(int) * template_capacity);
+						TEMPLATE_WIDTH = (int*) realloc(TEMPLATE_WIDTH, sizeof(int) * template_capacity);
+						TEMPLATE_HEIGHT = (int*) realloc(TEMPLATE_HEIGHT, sizeof(int) * template_capacity);
+					}
+					template_text[n_templates] = line;
+					TEMPLATE_WIDTH[n_templates] = TEMPLATE_HEIGHT[n_templates] = 0;
+					n_templates++;
+					in_template = true;
+				}
+				if (line_end - line > TEMPLATE_WIDTH[n_templates-1]) TEMPLATE_WIDTH[n_templates-1] = line_end - line;
+				TEMPLATE_HEIGHT[n_templates-1]++;
+				template_length[n_templates-1] = line_end - template_text[n_templates-1];
+			} else in_template = false;
+			if (!*line_end) break;
+			line = line_end + 1;
+		}
+	}
+	WIDTH = HEIGHT = 0;
+	for (t = 0; t < n_templates; t++) {
+		if (TEMPLATE_WIDTH[t] > WIDTH) WIDTH = TEMPLATE_WIDTH[t];
+		if (TEMPLATE_HEIGHT[t] > HEIGHT) HEIGHT = TEMPLATE_HEIGHT[t];
+	}
+	if (n_templates == 0) {
+		fprintf(PROGRESS, "Couldn't find any templates\n");
+		exit(EXIT_FAILURE);
+	}
+	set_directions();
+	
+	GAMESTATE_HASH_TABLE = (struct gamestate**) malloc(sizeof(struct gamestate*) * GAMESTATE_HASH_TABLE_SIZE);
+	for (i = 0; i < GAMESTATE_HASH_TABLE_SIZE; i++) GAMESTATE_HASH_TABLE[i] = NULL;
+	for (i = 0; i < GAMESTATE_HASH_LOCKS; i++) pthread_mutex_init(&GAMESTATE_HASH_LOCK[i], NULL);
+	setup_workers();
+	
+	//All templates share one board size, so the seeds of every template go in the same search
+	char* floor = (char*) malloc(sizeof(char) * SIZE);
+	for (i = 0; i < SIZE; i++) floor[i] = 0;
+	CURRENT_LAYER = (struct gamestate**) malloc(sizeof(struct gamestate*) * (n_templates * spawn_group_size + 1));
+	CURRENT_LAYER_SIZE = 0;
+	SEED_TEMPLATE = (int*) malloc(sizeof(int) * (n_templates * spawn_group_size + 1));
+	SEED_VALUE = (unsigned int*) malloc(sizeof(unsigned int) * (n_templates * spawn_group_size + 1));
+	for (t = 0; t < n_templates; t++) {
+		int initial_player_position, goals_already_provided;
+		char* level_template = parse_template(template_text[t], template_length[t], &initial_player_position, &goals_already_provided);
+		if (initial_player_position == -1 || goals_already_provided > N_GOALS) {
+			fprintf(PROGRESS, "Skipping template %d, it needs a player and at most %d goals\n", t + 1, N_GOALS);
+			free(level_template);
+			continue;
+		}
+		char* player_region = copy_level(level_template);
+		for (i = 0; i < SIZE; i++) player_region[i] &= WALL;
+		set_player_region(player_region, initial_player_position);
+		for (i = 0; i < SIZE; i++) floor[i] |= (player_region[i] & PLAYER) | (level_template[i] & GOAL);
+		for (i = 0; i < spawn_group_size; i++) {
+			unsigned int seed_value = base_seed + t * spawn_group_size + i;
+			srand(seed_value);
+			char* level = spawn_level(level_template, player_region, goals_already_provided);
+			if (!level) continue;
+			struct gamestate* state = make_new_gamestate(level, 0);
+			if (!state) {
+				free(level);
+				continue;
+			}
+			SEED_TEMPLATE[CURRENT_LAYER_SIZE] = t;
+			SEED_VALUE[CURRENT_LAYER_SIZE] = seed_value;
+			CURRENT_LAYER[CURRENT_LAYER_SIZE++] = state;
+		}
+		free(player_region);
+		free(level_template);
+	}
+	fprintf(PROGRESS, "Made %d starting states from %d templates\n", CURRENT_LAYER_SIZE, n_templates);
+	if (CURRENT_LAYER_SIZE == 0) exit(EXIT_FAILURE);
+	if (SIZE > 65535 || CURRENT_LAYER_SIZE > 65535) {
+		fprintf(PROGRESS, "Level too large for frontier search\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	N_SEEDS = CURRENT_LAYER_SIZE;
+	SEED_STATES = (int*) calloc(N_SEEDS, sizeof(int));
+	SEED_DEPTH = (int*) calloc(N_SEEDS, sizeof(int));
+	SEED_ALIVE = (bool*) malloc(sizeof(bool) * N_SEEDS);
+	for (i = 0; i < N_SEEDS; i++) SEED_ALIVE[i] = true;
+	BATCH_OUTPUT = output_path ? fopen(output_path, "a") : stdout;
+	if (!BATCH_OUTPUT) {
+		fprintf(PROGRESS, "Couldn't open %s\n", output_path);
+		exit(EXIT_FAILURE);
+	}
+	load_fingerprints(index_path);
+	
+	PIPELINE_ID = getpid();
+	if (SOLVER_PATH) start_solvers();
+	
+	setup_frontier_search(floor, N_SEEDS);
+	records_from_seeds();
+	SEED_DEEPEST = (unsigned short*) malloc(sizeof(unsigned short) * RECORD_LENGTH * N_SEEDS);
+	memcpy(SEED_DEEPEST, CURRENT_RECORDS, sizeof(unsigned short) * RECORD_LENGTH * N_SEEDS);
+	bool queue_full;
+	run_frontier_search(&queue_full);
+	if (queue_full) fprintf(PROGRESS, "Queue full, so stopping search\n");
+	if (SOLVER_PATH) finish_solvers();
+	fprintf(PROGRESS, "Wrote %d levels, skipped %d duplicates\n", LEVELS_WRITTEN, DUPLICATES_SKIPPED);
+	if (output_path) fclose(BATCH_OUTPUT);
+	if (FINGERPRINT_FILE) fclose(FINGERPRINT_FILE);
+	exit(EXIT_SUCCESS);
+}
+
+int main(int nargs, char** arglist) {
+	int i;
+	
+	if (nargs < 3) {
+		printf("Usage: gen SPAWN_GROUP_SIZE N_BOXES [--threads N] [--frontier] [--collection FILE [--level N | --title T]] [--batch [--output FILE] [--index FILE] [--seed N] [--verify SOLVER [--top K] [--solvers N] [--solver-timeout S]]]\n");
+		exit(EXIT_FAILURE);
+	}
 	int SPAWN_GROUP_SIZE = atoi(arglist[1]);
 	N_BOXES = N_GOALS = atoi(arglist[2]);
+	N_THREADS = count_processors();
+	N_SOLVERS = 0;
+	TOP_K = 100;
+	SOLVER_TIMEOUT = 60;
+	char* output_path = NULL;
+	char* index_path = NULL;
+	char* collection_path = NULL;
+	int level_number = 1;
+	char* level_title = NULL;
+	unsigned int base_seed = time(NULL);
+	for (i = 3; i < nargs; i++) {
+		if (!strcmp(arglist[i], "--threads") && i + 1 < nargs) N_THREADS = atoi(arglist[++i]);
+		else if (!strcmp(arglist[i], "--frontier")) FRONTIER_SEARCH = true;
+		else if (!strcmp(arglist[i], "--batch")) BATCH_MODE = FRONTIER_SEARCH = true;
+		else if (!strcmp(arglist[i], "--output") && i + 1 < nargs) output_path = arglist[++i];
+		else if (!strcmp(arglist[i], "--index") && i + 1 < nargs) index_path = arglist[++i];
+		else if (!strcmp(arglist[i], "--collection") && i + 1 < nargs) collection_path = arglist[++i];
+		else if (!strcmp(arglist[i], "--level") && i + 1 < nargs) level_number = atoi(arglist[++i]);
+		else if (!strcmp(arglist[i], "--title") && i + 1 < nargs) level_title = arglist[++i];
+		else if (!strcmp(arglist[i], "--seed") && i + 1 < nargs) base_seed = strtoul(arglist[++i], NULL, 10);
+		else if (!strcmp(arglist[i], "--verify") && i + 1 < nargs) {
+			SOLVER_PATH = arglist[++i];
+			BATCH_MODE = FRONTIER_SEARCH = true;
+		}
+		else if (!strcmp(arglist[i], "--top") && i + 1 < nargs) TOP_K = atoi(arglist[++i]);
+		else if (!strcmp(arglist[i], "--solvers") && i + 1 < nargs) N_SOLVERS = atoi(arglist[++i]);
+		else if (!strcmp(arglist[i], "--solver-timeout") && i + 1 < nargs) SOLVER_TIMEOUT = atoi(arglist[++i]);
+		else {
+			printf("Unknown option %s\n", arglist[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (N_THREADS < 1) N_THREADS = 1;
+	if (N_SOLVERS < 1) N_SOLVERS = (N_THREADS > 1) ? N_THREADS / 2 : 1;
+	if (TOP_K < 1) TOP_K = 1;
+	PROGRESS = BATCH_MODE ? stderr : stdout;
+	if (BATCH_MODE) run_batch(SPAWN_GROUP_SIZE, base_seed, output_path, index_path, collection_path);
 	
 	//Set paramters
-	srand(time(NULL));
+	srand(base_seed);
 	
-	//Read sok into INPUT_SOK
-	INPUT_SOK = (char*) malloc(sizeof(char) * MAX_LEVEL_SIZE);
-	int current_row_width = 0;
-	char c;
-	i = 0;
-	WIDTH = 0;
-	HEIGHT = 0;
-	do {
-		c = getchar();
-		INPUT_SOK[i++] = c;
-		if (c == '\n') {
-			if (current_row_width > WIDTH)
-				WIDTH = current_row_width;
-			current_row_width = 0;
-			HEIGHT++;
-		}
-		else current_row_width++;
-	} while (c != EOF && c != '\0');
-	if (current_row_width > WIDTH) WIDTH = current_row_width;
-	if (current_row_width) HEIGHT++;
+	//Read sok into INPUT_SOK, or point it at one level of a collection
+	int input_length;
+	if (collection_path) {
+		open_collection(collection_path);
+		struct collection_entry* entry = &COLLECTION_INDEX[find_collection_level(level_number, level_title)];
+		INPUT_SOK = COLLECTION_DATA + entry->board_offset;
+		input_length = entry->board_length;
+		measure_board(INPUT_SOK, input_length);
+	} else {
+		INPUT_SOK = (char*) malloc(sizeof(char) * MAX_LEVEL_SIZE);
+		int current_row_width = 0;
+		char c;
+		i = 0;
+		WIDTH = 0;
+		HEIGHT = 0;
+		do {
+			c = getchar();
+			INPUT_SOK[i++] = c;
+			if (c == '\n') {
+				if (current_row_width > WIDTH)
+					WIDTH = current_row_width;
+				current_row_width = 0;
+				HEIGHT++;
+			}
+			else current_row_width++;
+		} while (c != EOF && c != '\0');
+		if (current_row_width > WIDTH) WIDTH = current_row_width;
+		if (current_row_width) HEIGHT++;
+		input_length = i;
+	}
 	//WIDTH--;
-	DIRECTIONS[0] = LEFT = -1;
-	DIRECTIONS[1] = UP = -WIDTH;
-	DIRECTIONS[2] = RIGHT = 1;
-	DIRECTIONS[3] = DOWN = WIDTH;
+	set_directions();
 	
 	//Read INPUT_SOK into a level
-	int initial_player_position = -1;
-	char* level_template = (char*) malloc(sizeof(char) * SIZE);
-	for (i = 0; i < SIZE; i++) level_template[i] = 0;
-	j = 0;
-	int goals_already_provided = 0;
-	for (i = 0; i < SIZE;) {
-		c = INPUT_SOK[j++];
-		if (c == '\n') {
-			while (i%WIDTH) i++;
-			continue;
-		}
-		if (c == EOF || c == '\0') break;
-		level_template[i] = sok_to_native(c);
-		/* if (level_template[i] != WALL && level_template[i] != EMPTY) {
-			if (level_template[i] == PLAYER) {
-				//ok that's fine...
-				initial_player_position = i;
-				level_template[i] = EMPTY;
-			} else {
-				printf("Your inputted level shouldn't have anything other than walls\n");
-				exit(EXIT_FAILURE);
-			}
-		} */
-		if (level_template[i] & PLAYER) initial_player_position = i;
-		level_template[i] &= ~BOX;
-		if (level_template[i] & GOAL) {
-			goals_already_provided++;
-			level_template[i] |= BOX;
-		}
-		i++;
-	}
-	free(INPUT_SOK);
+	int initial_player_position;
+	int goals_already_provided;
+	char* level_template = parse_template(INPUT_SOK, input_length, &initial_player_position, &goals_already_provided);
+	if (!collection_path) free(INPUT_SOK);
 	
 	if (initial_player_position == -1) {
 		printf("You didn't provide a player position\n");
@@ -258,39 +1295,23 @@ int main(int nargs, char** arglist) {
 	//Setup hash table and stuff
 	GAMESTATE_HASH_TABLE = (struct gamestate**) malloc(sizeof(struct gamestate*) * GAMESTATE_HASH_TABLE_SIZE);
 	for (i = 0; i < GAMESTATE_HASH_TABLE_SIZE; i++) GAMESTATE_HASH_TABLE[i] = NULL;
+	for (i = 0; i < GAMESTATE_HASH_LOCKS; i++) pthread_mutex_init(&GAMESTATE_HASH_LOCK[i], NULL);
+	setup_workers();
 	
-	struct gamestate** neighbors = (struct gamestate**) malloc(sizeof(struct gamestate*) * GROWTH_FACTOR);
-	
-	struct gamestate** queue = (struct gamestate**) malloc(sizeof(struct gamestate*) * QUEUE_SIZE);
-	int push_spot = 0;
-	int pop_spot = 0;
+	CURRENT_LAYER = (struct gamestate**) malloc(sizeof(struct gamestate*) * (SPAWN_GROUP_SIZE + 1));
+	CURRENT_LAYER_SIZE = 0;
 	int max_complexity_seen = -1;
 	
 	//Generate a bunch of levels based on level_template
 	for (i = 0; i < SPAWN_GROUP_SIZE; i++) {
-		char* level = copy_level(level_template);
-		int things_placed = goals_already_provided;
-		int player_spot;
-		for (j = 0; j < 100 && things_placed < N_BOXES+1; j++) { //j is # attempts at placing things
-			int spot = rand() % SIZE;
-			if (!(indicate_player_region[spot] & PLAYER)) continue;
-			if (level[spot]) continue;
-			if (things_placed > goals_already_provided) {
-				level[spot] = BOX | GOAL;
-			} else {
-				level[spot] = PLAYER | OG_PLAYER;
-				player_spot = spot;
-			}
-			things_placed++;
-		}
-		if (things_placed != N_BOXES+1) continue;
+		char* level = spawn_level(level_template, indicate_player_region, goals_already_provided);
+		if (!level) continue;
 		
-		set_player_region(level, player_spot);
 		struct gamestate* state = make_new_gamestate(level, 0);
 		if (state) {
-			printf("Made starting state #%d\n", push_spot);
+			printf("Made starting state #%d\n", CURRENT_LAYER_SIZE);
 			print_level(level);
-			queue[push_spot++] = state;
+			CURRENT_LAYER[CURRENT_LAYER_SIZE++] = state;
 		} else {
 			printf("Spawn attempt #%d failed\n", i);
 			free(level);
@@ -299,24 +1320,64 @@ int main(int nargs, char** arglist) {
 	
 	printf("Made starting states\n");
 	//exit(EXIT_FAILURE);
+	if (CURRENT_LAYER_SIZE == 0) {
+		printf("Couldn't make any starting states\n");
+		exit(EXIT_FAILURE);
+	}
 	
-	struct gamestate* most_complex;
-	while (push_spot < QUEUE_SIZE && pop_spot < push_spot) {
-		struct gamestate* pick = queue[pop_spot++];
-		find_new_pre_states(neighbors, pick);
-		for (i = 0; i < GROWTH_FACTOR && neighbors[i]; i++) {
-			//printf("%08X go to %08X perhaps\n", pick, neighbors[i]);
-			queue[push_spot++] = neighbors[i];
-			if (neighbors[i]->complexity > max_complexity_seen) {
-				max_complexity_seen = neighbors[i]->complexity;
-				printf("[%d]\n", max_complexity_seen);
-				print_level(neighbors[i]->level);
-				most_complex = neighbors[i];
+	if (FRONTIER_SEARCH) {
+		if (SIZE > 65535 || CURRENT_LAYER_SIZE > 65535) {
+			printf("Level too large for frontier search\n");
+			exit(EXIT_FAILURE);
+		}
+		char* floor = copy_level(indicate_player_region);
+		for (i = 0; i < SIZE; i++) floor[i] |= level_template[i] & GOAL;
+		setup_frontier_search(floor, CURRENT_LAYER_SIZE);
+		free(floor);
+		records_from_seeds();
+		bool queue_full;
+		char* most_complex_level = run_frontier_search(&queue_full);
+		printf("\n\n\n");
+		if (queue_full) printf("Queue full, so stopping search\n");
+		else printf("Found absolute maximum shuffle!\n");
+		print_level(most_complex_level);
+		exit(EXIT_FAILURE);
+	}
+	
+	//BFS one layer at a time, each layer expanded by all threads
+	struct gamestate* most_complex = CURRENT_LAYER[0];
+	bool queue_full = false;
+	while (CURRENT_LAYER_SIZE) {
+		if (STATES_STORED >= QUEUE_SIZE) {
+			queue_full = true;
+			break;
+		}
+		expand_layer();
+		int next_layer_size = 0;
+		int t;
+		for (t = 0; t < N_THREADS; t++) next_layer_size += WORKERS[t].found_count;
+		struct gamestate** next_layer = (struct gamestate**) malloc(sizeof(struct gamestate*) * (next_layer_size + 1));
+		next_layer_size = 0;
+		bool found_more_complex = false;
+		for (t = 0; t < N_THREADS; t++) {
+			for (i = 0; i < WORKERS[t].found_count; i++) next_layer[next_layer_size++] = WORKERS[t].found[i];
+			struct gamestate* contender = WORKERS[t].most_complex;
+			if (contender && contender->complexity > max_complexity_seen) {
+				max_complexity_seen = contender->complexity;
+				most_complex = contender;
+				found_more_complex = true;
 			}
 		}
+		if (found_more_complex) {
+			printf("[%d]\n", max_complexity_seen);
+			print_level(most_complex->level);
+		}
+		free(CURRENT_LAYER);
+		CURRENT_LAYER = next_layer;
+		CURRENT_LAYER_SIZE = next_layer_size;
 	}
 	printf("\n\n\n");
-	if (push_spot == QUEUE_SIZE) printf("Queue full, so stopping search\n");
+	if (queue_full) printf("Queue full, so stopping search\n");
 	else printf("Found absolute maximum shuffle!\n");
 	print_level(most_complex->level);
 	exit(EXIT_FAILURE);
@@ -0,0 +1,21 @@
+//Shared by the solver and the generator, for sizing their thread pools
+#ifndef PROCESSORS_H
+#define PROCESSORS_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+int count_processors() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+#endif
@@ -0,0 +1,150 @@
+//Shared by the solver and the generator, which both include it after defining SIZE, WIDTH, DIRECTIONS, BOX and WALL
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+
+//Incremental reachability: the free squares of the level being expanded get labelled by connected region as they're
+//needed, and a child's player region is put together from those labels. Moving one box only changes the squares it
+//leaves and enters, so a full flood is only needed when the square it enters might cut a region in two
+struct reachability {
+	int* label; //region of each free square of the parent, good while label_stamp matches stamp
+	int* label_stamp;
+	int stamp;
+	int labels;
+	int* label_lowest;
+	int* label_mark; //regions in the child's player region, while equal to mark
+	int mark;
+	int* square_mark; //the child's player region itself, when it had to be flooded
+	bool flooded;
+	bool has_box_from;
+	int box_from;
+	int box_to;
+	int* queue;
+};
+
+void setup_reachability(struct reachability* reach) {
+	reach->label = (int*) malloc(sizeof(int) * SIZE);
+	reach->label_stamp = (int*) calloc(SIZE, sizeof(int));
+	reach->label_lowest = (int*) malloc(sizeof(int) * SIZE);
+	reach->label_mark = (int*) calloc(SIZE, sizeof(int));
+	reach->square_mark = (int*) calloc(SIZE, sizeof(int));
+	reach->queue = (int*) malloc(sizeof(int) * SIZE);
+	reach->stamp = 0;
+	reach->mark = 0;
+}
+
+//Forget the labels, for a new parent level
+void begin_reachability(struct reachability* reach) {
+	if (reach->stamp == INT_MAX) {
+		memset(reach->label_stamp, 0, sizeof(int) * SIZE);
+		reach->stamp = 0;
+	}
+	reach->stamp++;
+	reach->labels = 0;
+}
+
+int region_of(struct reachability* reach, char* level, int square) {
+	if (reach->label_stamp[square] == reach->stamp) return reach->label[square];
+	int front, back = 0, d, region = reach->labels++;
+	reach->label_lowest[region] = square;
+	reach->label[square] = region;
+	reach->label_stamp[square] = reach->stamp;
+	reach->queue[back++] = square;
+	for (front = 0; front < back; front++) for (d = 0; d < 4; d++) {
+		int next = reach->queue[front] + DIRECTIONS[d];
+		if (reach->label_stamp[next] == reach->stamp || (level[next] & (WALL | BOX))) continue;
+		reach->label[next] = region;
+		reach->label_stamp[next] = reach->stamp;
+		if (next < reach->label_lowest[region]) reach->label_lowest[region] = next;
+		reach->queue[back++] = next;
+	}
+	return region;
+}
+
+bool free_after_move(char* level, int box_from, int box_to, int square) {
+	return square == box_from || (square != box_to && !(level[square] & (WALL | BOX)));
+}
+
+//Could a box arriving at box_to cut a region in two? Not if the free squares beside it are all still joined
+//around it, going through the eight squares that surround it
+bool move_splits_region(char* level, int box_from, int box_to) {
+	int ring[8] = {-WIDTH, -WIDTH+1, 1, WIDTH+1, WIDTH, WIDTH-1, -1, -WIDTH-1};
+	int i, start = -1, runs = 0;
+	bool in_run = false, run_has_side = false;
+	for (i = 0; i < 8; i++) if (!free_after_move(level, box_from, box_to, box_to + ring[i])) start = i;
+	if (start < 0) return false;
+	for (i = 1; i <= 8; i++) {
+		int k = (start + i) % 8;
+		if (free_after_move(level, box_from, box_to, box_to + ring[k])) {
+			in_run = true;
+			if (k % 2 == 0) run_has_side = true;
+		} else {
+			if (in_run && run_has_side) runs++;
+			in_run = run_has_side = false;
+		}
+	}
+	return runs > 1;
+}
+
+//Work out the player region after box_from moves to box_to with the player at player, returning its lowest square
+int mark_child_region(struct reachability* reach, char* level, int box_from, int box_to, int player) {
+	int d, i, lowest = INT_MAX;
+	int marked[5];
+	int n_marked = 0;
+	if (reach->mark == INT_MAX) {
+		memset(reach->label_mark, 0, sizeof(int) * SIZE);
+		memset(reach->square_mark, 0, sizeof(int) * SIZE);
+		reach->mark = 0;
+	}
+	reach->mark++;
+	reach->box_from = box_from;
+	reach->box_to = box_to;
+	reach->flooded = false;
+	reach->has_box_from = (player == box_from);
+	if (!reach->has_box_from) {
+		marked[n_marked++] = region_of(reach, level, player);
+		for (d = 0; d < 4; d++) {
+			int next = box_from + DIRECTIONS[d];
+			if (next != box_to && !(level[next] & (WALL | BOX)) && region_of(reach, level, next) == marked[0]) reach->has_box_from = true;
+		}
+	}
+	//box_from joins up every region beside it
+	if (reach->has_box_from) for (d = 0; d < 4; d++) {
+		int next = box_from + DIRECTIONS[d];
+		if (next != box_to && !(level[next] & (WALL | BOX))) marked[n_marked++] = region_of(reach, level, next);
+	}
+	for (i = 0; i < n_marked; i++) reach->label_mark[marked[i]] = reach->mark;
+	int to_region = region_of(reach, level, box_to);
+	if (reach->label_mark[to_region] == reach->mark)
+		if (reach->label_lowest[to_region] == box_to || move_splits_region(level, box_from, box_to)) {
+			//box_to may have cut the region, flood it
+			int front, back = 0;
+			reach->flooded = true;
+			reach->square_mark[player] = reach->mark;
+			reach->queue[back++] = player;
+			lowest = player;
+			for (front = 0; front < back; front++) for (d = 0; d < 4; d++) {
+				int next = reach->queue[front] + DIRECTIONS[d];
+				if (reach->square_mark[next] == reach->mark || !free_after_move(level, box_from, box_to, next)) continue;
+				reach->square_mark[next] = reach->mark;
+				if (next < lowest) lowest = next;
+				reach->queue[back++] = next;
+			}
+			return lowest;
+		}
+	if (reach->has_box_from) lowest = box_from;
+	for (i = 0; i < n_marked; i++) if (reach->label_lowest[marked[i]] < lowest) lowest = reach->label_lowest[marked[i]];
+	return lowest;
+}
+
+bool in_child_region(struct reachability* reach, int square) {
+	if (reach->flooded) return reach->square_mark[square] == reach->mark;
+	if (square == reach->box_from) return reach->has_box_from;
+	return square != reach->box_to && reach->label_stamp[square] == reach->stamp && reach->label_mark[reach->label[square]] == reach->mark;
+}
+
+#endif
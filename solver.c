@@ -1,7 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #define MAX_LEVEL_SIZE 65536
 
@@ -49,10 +60,15 @@ int** BOX_PUSHING_DISTANCE_MATRIX; //M[i][j] is minimum # pushes to push a box f
 
 #define GAMESTATE_HASH_TABLE_SIZE (65536)
 struct gamestate** GAMESTATE_HASH_TABLE;
+int STATES_STORED = 0;
+
+//Partial expansion: an expanded state only stores the children it would expand right away,
+//and goes back into the frontier with the priority of the best child it held back
+bool PARTIAL_EXPANSION = false;
 
 struct gamestate {
 	char* level;
-	int hash;
+	unsigned int hash;
 	struct gamestate* next_in_hash_table;
 	struct gamestate* point_back;
 	char origin_side;
@@ -60,7 +76,8 @@ struct gamestate {
 	int h_score; //precomputed, heuristic
 	int g_score;
 	int f_score;
-	bool ever_been_in_frontier;
+	int priority; //MM priority, max(f, 2g) - keeps both searches from expanding past the midpoint
+	int heap_index; //position in its side's frontier, or -1 when not in the frontier
 };
 
 bool identical_levels(char* a, char* b) {
@@ -75,10 +92,10 @@ char* copy_level(char* level) {
 	return copy;
 }
 
-int level_hash(char* level) {
+unsigned int level_hash(char* level) {
 	int i;
-	int h = 0;
-	for (i = 0; i < SIZE; i++) if (level[i] & BOX) h += i*i*i;
+	unsigned int h = 0;
+	for (i = 0; i < SIZE; i++) if (level[i] & BOX) h += (unsigned int) i*i*i;
 	for (i = 0; i < SIZE; i++) if (level[i] & PLAYER) return h + i;
 	printf("Couldn't compute level hash - has no players?\n");
 	exit(EXIT_FAILURE);
@@ -102,12 +119,8 @@ int hungarian(int* weights, int n) {
 
 
 
-int level_heuristic(char* level, int origin_side) {
-	int i;
-	int j = 0;
-	int* box_positions = (int*) malloc(sizeof(int) * N_BOXES);
-	for (i = 0; i < SIZE; i++) if (level[i] & BOX) box_positions[j++] = i;
-	
+int boxes_heuristic(int* box_positions, int origin_side) {
+	int i, j;
 	int* weights = (int*) malloc(sizeof(int) * N_BOXES * N_BOXES);
 	
 	if (origin_side == FROM_LEFT_SIDE) {
@@ -118,37 +131,57 @@ int level_heuristic(char* level, int origin_side) {
 			weights[i*N_BOXES+j] = BOX_PUSHING_DISTANCE_MATRIX[INITIAL_BOX_POSITIONS[i]][box_positions[j]];
 	}
 	int result = hungarian(weights, N_BOXES);
+	free(weights);
+	return result;
+}
+int level_heuristic(char* level, int origin_side) {
+	int i;
+	int j = 0;
+	int* box_positions = (int*) malloc(sizeof(int) * N_BOXES);
+	for (i = 0; i < SIZE; i++) if (level[i] & BOX) box_positions[j++] = i;
+	int result = boxes_heuristic(box_positions, origin_side);
 	free(box_positions);
 	return result;
 }
 
-struct gamestate* make_gamestate(char* level, int origin_side) {
-	int hash = level_hash(level);
+//Each side keeps its own node for a position, so both searches can hold a g score for it
+struct gamestate* find_gamestate(char* level, unsigned int hash, int origin_side) {
 	struct gamestate* walker = GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE];
 	while (walker) {
-		if (walker->hash == hash) if (identical_levels(walker->level, level)) {
-			if (origin_side != walker->origin_side) {
-				// printf("( From other side ! )\n");
-			}
-			free(level);
+		if (walker->hash == hash) if (walker->origin_side == origin_side) if (identical_levels(walker->level, level))
 			return walker;
-		}
 		walker = walker->next_in_hash_table;
 	}
+	return NULL;
+}
+
+struct gamestate* insert_gamestate(char* level, unsigned int hash, int h_score, int origin_side) {
 	struct gamestate* new_node = (struct gamestate*) malloc(sizeof(struct gamestate));
 	new_node->level = level;
 	new_node->hash = hash;
 	new_node->next_in_hash_table = GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE];
 	new_node->origin_side = origin_side;
 	new_node->point_back = NULL;
-	new_node->h_score = level_heuristic(level, origin_side);
+	new_node->h_score = h_score;
 	new_node->g_score = INT_MAX;
 	new_node->f_score = INT_MAX;
-	new_node->ever_been_in_frontier = false;
+	new_node->priority = INT_MAX;
+	new_node->heap_index = -1;
 	GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE] = new_node;
+	STATES_STORED++;
 	return new_node;
 }
 
+struct gamestate* make_gamestate(char* level, int origin_side) {
+	unsigned int hash = level_hash(level);
+	struct gamestate* existing = find_gamestate(level, hash, origin_side);
+	if (existing) {
+		free(level);
+		return existing;
+	}
+	return insert_gamestate(level, hash, level_heuristic(level, origin_side), origin_side);
+}
+
 char sok_to_native(char sok) {
 	if (sok == ' ') return EMPTY;
 	if (sok == '#') return WALL;
@@ -208,133 +241,604 @@ void set_player_region(char* level, int player_position) {
 	level[player_position] |= OG_PLAYER;
 }
 
+//Packing order: a goal area is a connected group of goals with no box on them at the start. Taking the boxes
+//back out of a full area one at a time (pulling, with the rest standing still) gives an order to fill it in.
+//With --packing-order, goals of an area that are filled in that order stay put, a box stopped on an area goal
+//out of turn is the only box that may move until it gets somewhere, and end states only have the player next
+//to a box that could have been pushed in last
+bool PACKING_ORDER = false;
+int* GOAL_AREA; //area number of each square, -1 if it isn't in one
+int* PACKING_RANK; //1 for the goal of an area that is filled first
+int N_AREAS = 0;
+int* AREA_SIZE;
+int** AREA_GOALS; //goals of each area, by rank
+int* AREA_SETTLED; //how many goals of each area are filled in order, for the state being expanded
+
+//Scratch space for working the order out
+char* PACKING_BLOCKED; //walls, squares the player can't get to, and boxes standing still
+char* PACKING_REACH;
+char* PACKING_REGION;
+char* PACKING_SEEN; //SIZE*SIZE, indexed by box square and lowest square of the player's region
+int* PACKING_QUEUE;
+int* PACKING_BOXES;
+int* PACKING_PLAYERS;
+int* PACKING_KEYS;
+
+//Flood from square through squares that aren't blocked, returning the lowest square reached
+int flood_reach(char* reach, int square) {
+	int front, back = 0, d, lowest = square;
+	memset(reach, 0, SIZE);
+	reach[square] = 1;
+	PACKING_QUEUE[back++] = square;
+	for (front = 0; front < back; front++) for (d = 0; d < 4; d++) {
+		int next = PACKING_QUEUE[front] + DIRECTIONS[d];
+		if (PACKING_BLOCKED[next] || reach[next]) continue;
+		reach[next] = 1;
+		if (next < lowest) lowest = next;
+		PACKING_QUEUE[back++] = next;
+	}
+	return lowest;
+}
+
+//Can the box on goal be pulled out of its area, with every other blocked square standing still?
+bool can_retrieve(int goal, int area) {
+	int i, d, front, back = 0;
+	bool retrieved = false;
+	//the player comes in from where it starts, which isn't in the area
+	PACKING_BLOCKED[goal] = 1;
+	flood_reach(PACKING_REACH, INITIAL_PLAYER_POSITION);
+	PACKING_BLOCKED[goal] = 0;
+	PACKING_BOXES[back] = goal;
+	PACKING_PLAYERS[back++] = -1;
+	for (front = 0; front < back && !retrieved; front++) {
+		int box = PACKING_BOXES[front];
+		PACKING_BLOCKED[box] = 1;
+		if (PACKING_PLAYERS[front] >= 0) flood_reach(PACKING_REACH, PACKING_PLAYERS[front]);
+		for (d = 0; d < 4 && !retrieved; d++) {
+			int pulled_to = box + DIRECTIONS[d];
+			int player_to = pulled_to + DIRECTIONS[d];
+			if (!PACKING_REACH[pulled_to] || PACKING_BLOCKED[player_to]) continue;
+			if (GOAL_AREA[pulled_to] != area) {
+				retrieved = true;
+				continue;
+			}
+			//pulls are told apart by where the box ends up and which region the player is left in
+			PACKING_BLOCKED[box] = 0;
+			PACKING_BLOCKED[pulled_to] = 1;
+			int key = pulled_to * SIZE + flood_reach(PACKING_REGION, player_to);
+			PACKING_BLOCKED[pulled_to] = 0;
+			PACKING_BLOCKED[box] = 1;
+			if (PACKING_SEEN[key]) continue;
+			PACKING_SEEN[key] = 1;
+			PACKING_KEYS[back] = key;
+			PACKING_BOXES[back] = pulled_to;
+			PACKING_PLAYERS[back++] = player_to;
+		}
+		PACKING_BLOCKED[box] = 0;
+	}
+	for (i = 1; i < back; i++) PACKING_SEEN[PACKING_KEYS[i]] = 0;
+	return retrieved;
+}
+
+void compute_packing_order(char* start_level) {
+	int i, j, d;
+	GOAL_AREA = (int*) malloc(sizeof(int) * SIZE);
+	PACKING_RANK = (int*) malloc(sizeof(int) * SIZE);
+	AREA_SIZE = (int*) malloc(sizeof(int) * N_GOALS);
+	AREA_GOALS = (int**) malloc(sizeof(int*) * N_GOALS);
+	AREA_SETTLED = (int*) malloc(sizeof(int) * N_GOALS);
+	PACKING_BLOCKED = (char*) malloc(SIZE);
+	PACKING_REACH = (char*) malloc(SIZE);
+	PACKING_REGION = (char*) malloc(SIZE);
+	PACKING_SEEN = (char*) calloc((size_t) SIZE * SIZE, sizeof(char));
+	PACKING_QUEUE = (int*) malloc(sizeof(int) * SIZE);
+	PACKING_BOXES = (int*) malloc(sizeof(int) * 4 * SIZE);
+	PACKING_PLAYERS = (int*) malloc(sizeof(int) * 4 * SIZE);
+	PACKING_KEYS = (int*) malloc(sizeof(int) * 4 * SIZE);
+	for (i = 0; i < SIZE; i++) {
+		GOAL_AREA[i] = -1;
+		PACKING_RANK[i] = 0;
+		PACKING_BLOCKED[i] = (start_level[i] & WALL) ? 1 : 0;
+	}
+	//only squares the player can get to count as floor; boxes already on goals are taken to stay there
+	int* area_queue = (int*) malloc(sizeof(int) * SIZE);
+	flood_reach(PACKING_REGION, INITIAL_PLAYER_POSITION);
+	for (i = 0; i < SIZE; i++)
+		if (!PACKING_REGION[i] || ((start_level[i] & BOX) && (start_level[i] & GOAL))) PACKING_BLOCKED[i] = 1;
+	for (i = 0; i < SIZE; i++) if ((start_level[i] & GOAL) && !PACKING_BLOCKED[i] && GOAL_AREA[i] == -1) {
+		int area = N_AREAS;
+		int size = 0;
+		bool has_player = false;
+		GOAL_AREA[i] = area;
+		area_queue[size++] = i;
+		for (j = 0; j < size; j++) {
+			if (area_queue[j] == INITIAL_PLAYER_POSITION) has_player = true;
+			for (d = 0; d < 4; d++) {
+				int next = area_queue[j] + DIRECTIONS[d];
+				if (!(start_level[next] & GOAL) || PACKING_BLOCKED[next] || GOAL_AREA[next] >= 0) continue;
+				GOAL_AREA[next] = area;
+				area_queue[size++] = next;
+			}
+		}
+		AREA_SIZE[area] = size;
+		AREA_GOALS[area] = (int*) malloc(sizeof(int) * size);
+		for (j = 0; j < size; j++) AREA_GOALS[area][j] = area_queue[j];
+		//fill the area, then keep taking out a box that can still leave; that one goes in last of those left
+		bool ordered = size >= 2 && !has_player;
+		for (j = 0; j < size; j++) PACKING_BLOCKED[AREA_GOALS[area][j]] = 1;
+		int rank;
+		for (rank = size; rank > 0 && ordered; rank--) {
+			int found = -1;
+			for (j = 0; j < size && found < 0; j++) {
+				int goal = AREA_GOALS[area][j];
+				if (PACKING_RANK[goal]) continue;
+				PACKING_BLOCKED[goal] = 0;
+				if (can_retrieve(goal, area)) found = goal;
+				else PACKING_BLOCKED[goal] = 1;
+			}
+			if (found < 0) ordered = false;
+			else PACKING_RANK[found] = rank;
+		}
+		for (j = 0; j < size; j++) PACKING_BLOCKED[AREA_GOALS[area][j]] = 0;
+		if (!ordered) {
+			for (j = 0; j < size; j++) {
+				GOAL_AREA[AREA_GOALS[area][j]] = -2; //looked at already
+				PACKING_RANK[AREA_GOALS[area][j]] = 0;
+			}
+			free(AREA_GOALS[area]);
+			continue;
+		}
+		for (j = 0; j < size; j++) area_queue[j] = AREA_GOALS[area][j];
+		for (j = 0; j < size; j++) AREA_GOALS[area][PACKING_RANK[area_queue[j]] - 1] = area_queue[j];
+		N_AREAS++;
+	}
+	for (i = 0; i < SIZE; i++) if (GOAL_AREA[i] == -2) GOAL_AREA[i] = -1;
+	free(area_queue);
+}
+
+//Work out AREA_SETTLED for level, and find the box stopped on an area goal out of turn
+//(-1 if there isn't one, -2 if there's more than one, which shouldn't come up)
+int find_transit_box(char* level) {
+	int area, i, transit_box = -1;
+	for (area = 0; area < N_AREAS; area++) {
+		for (AREA_SETTLED[area] = 0; AREA_SETTLED[area] < AREA_SIZE[area]; AREA_SETTLED[area]++)
+			if (!(level[AREA_GOALS[area][AREA_SETTLED[area]]] & BOX)) break;
+		for (i = AREA_SETTLED[area]; i < AREA_SIZE[area]; i++) if (level[AREA_GOALS[area][i]] & BOX) {
+			if (transit_box != -1) return -2;
+			transit_box = AREA_GOALS[area][i];
+		}
+	}
+	return transit_box;
+}
+
+bool packing_allows_push(int box, int transit_box) {
+	if (transit_box != -1 && box != transit_box) return false;
+	return GOAL_AREA[box] < 0 || PACKING_RANK[box] > AREA_SETTLED[GOAL_AREA[box]];
+}
+
+#include "reachability.h"
+struct reachability REACHABILITY;
+
+//A push (or pull) is kept as just what it changes until it's known to lead somewhere new
+struct move {
+	int box_from;
+	int box_to;
+	int player; //where the player stands once it's done
+};
+int* EXPANDED_BOXES; //boxes of the state being expanded
+unsigned int EXPANDED_BOX_SUM; //their share of level_hash
+int* CHILD_BOXES;
+char* PUSH_DEAD_SQUARES; //squares a box can't be pushed to any goal from
+char* PULL_DEAD_SQUARES; //squares no box can be pushed to from the start
 
-void find_post_states(struct gamestate** list, struct gamestate* state) {
-	int i, d, j;
+void setup_move_structures() {
+	int i, j;
+	EXPANDED_BOXES = (int*) malloc(sizeof(int) * N_BOXES);
+	CHILD_BOXES = (int*) malloc(sizeof(int) * N_BOXES);
+	PUSH_DEAD_SQUARES = (char*) malloc(sizeof(char) * SIZE);
+	PULL_DEAD_SQUARES = (char*) malloc(sizeof(char) * SIZE);
+	setup_reachability(&REACHABILITY);
+	for (i = 0; i < SIZE; i++) {
+		PUSH_DEAD_SQUARES[i] = 1;
+		PULL_DEAD_SQUARES[i] = 1;
+		for (j = 0; j < N_GOALS; j++) if (BOX_PUSHING_DISTANCE_MATRIX[i][GOAL_POSITIONS[j]] != INT_MAX) PUSH_DEAD_SQUARES[i] = 0;
+		for (j = 0; j < N_BOXES; j++) if (BOX_PUSHING_DISTANCE_MATRIX[INITIAL_BOX_POSITIONS[j]][i] != INT_MAX) PULL_DEAD_SQUARES[i] = 0;
+	}
+}
+
+//Fill moves with every push (or pull) out of state, working off its box list and player region.
+//No two moves lead to the same child, since they leave different sets of boxes
+int find_moves(struct move* moves, struct gamestate* state) {
 	char* level = state->level;
-	for (i = 0; i < GROWTH_FACTOR; i++) list[i] = NULL;
-	int entries = 0;
-	for (i = 0; i < SIZE; i++) if (level[i] & BOX) for (d = 0; d < 4; d++) {
-		int before_box = i - DIRECTIONS[d];
-		int after_box = i + DIRECTIONS[d];
-		//before_box is player, after_box is empty space. push the box there
-		if (!(level[before_box] & WALL)) if (!(level[before_box] & BOX)) if (level[before_box] & PLAYER)
-			if (!(level[after_box] & WALL)) if (!(level[after_box] & BOX)) {
-				char* new_level = copy_level(level);
-				new_level[i] &= ~BOX;
-				new_level[after_box] |= BOX;
-				set_player_region(new_level, i);
-				struct gamestate* new_state = make_gamestate(new_level, state->origin_side);
-				bool already_found = false;
-				for (j = 0; j < entries && !already_found; j++) if (list[j] == new_state) already_found = true;
-				if (!already_found) list[entries++] = new_state;
+	int i, d, n_moves = 0, n_found = 0;
+	EXPANDED_BOX_SUM = 0;
+	begin_reachability(&REACHABILITY);
+	for (i = 0; i < SIZE; i++) if (level[i] & BOX) {
+		EXPANDED_BOXES[n_found++] = i;
+		EXPANDED_BOX_SUM += (unsigned int) i*i*i;
+	}
+	int transit_box = (PACKING_ORDER && state->origin_side == FROM_LEFT_SIDE) ? find_transit_box(level) : -1;
+	for (i = 0; i < N_BOXES; i++) {
+		int box = EXPANDED_BOXES[i];
+		if (PACKING_ORDER && state->origin_side == FROM_LEFT_SIDE && !packing_allows_push(box, transit_box)) continue;
+		for (d = 0; d < 4; d++) {
+			int after_box = box + DIRECTIONS[d];
+			if (state->origin_side == FROM_LEFT_SIDE) {
+				//player behind the box, after_box is empty space. push the box there
+				if (!(level[box - DIRECTIONS[d]] & PLAYER)) continue;
+				if (level[after_box] & (WALL | BOX) || PUSH_DEAD_SQUARES[after_box]) continue;
+				moves[n_moves].player = box;
+			} else {
+				//player at after_box, the square past it is empty space. pull the box
+				int after_after_box = after_box + DIRECTIONS[d];
+				if (!(level[after_box] & PLAYER)) continue;
+				if (level[after_after_box] & (WALL | BOX) || PULL_DEAD_SQUARES[after_box]) continue;
+				moves[n_moves].player = after_after_box;
 			}
+			moves[n_moves].box_from = box;
+			moves[n_moves++].box_to = after_box;
+		}
 	}
+	return n_moves;
 }
-void find_pre_states(struct gamestate** list, struct gamestate* state) {
-	int i, d, j;
+
+//Same as level_hash on the child, given the lowest square of its player region
+unsigned int move_hash(struct move* move, int lowest) {
+	unsigned int from = move->box_from, to = move->box_to;
+	return EXPANDED_BOX_SUM - from*from*from + to*to*to + lowest;
+}
+
+int move_heuristic(struct move* move, int origin_side) {
+	int i;
+	for (i = 0; i < N_BOXES; i++) CHILD_BOXES[i] = (EXPANDED_BOXES[i] == move->box_from) ? move->box_to : EXPANDED_BOXES[i];
+	return boxes_heuristic(CHILD_BOXES, origin_side);
+}
+
+//Is stored the child level of level after move? Its region has to be marked already, with mark_child_region
+bool is_move_child(char* stored, char* level, struct move* move) {
+	int i;
+	for (i = 0; i < SIZE; i++) {
+		char expected = level[i] & ~(PLAYER | OG_PLAYER);
+		if (i == move->box_from) expected &= ~BOX;
+		if (i == move->box_to) expected |= BOX;
+		if (in_child_region(&REACHABILITY, i)) expected |= PLAYER;
+		if ((stored[i] & ~OG_PLAYER) != expected) return false;
+	}
+	return true;
+}
+struct gamestate* find_move_child(char* level, struct move* move, unsigned int hash, int origin_side) {
+	struct gamestate* walker = GAMESTATE_HASH_TABLE[hash % GAMESTATE_HASH_TABLE_SIZE];
+	while (walker) {
+		if (walker->hash == hash) if (walker->origin_side == origin_side) if (is_move_child(walker->level, level, move))
+			return walker;
+		walker = walker->next_in_hash_table;
+	}
+	return NULL;
+}
+
+//Only a move that gets stored turns into a full level
+char* build_move_child(char* level, struct move* move) {
+	char* child = (char*) malloc(sizeof(char) * SIZE);
+	int i;
+	for (i = 0; i < SIZE; i++)
+		child[i] = (level[i] & ~(PLAYER | OG_PLAYER)) | (in_child_region(&REACHABILITY, i) ? PLAYER : 0);
+	child[move->box_from] &= ~BOX;
+	child[move->box_to] |= BOX;
+	child[move->player] |= OG_PLAYER;
+	return child;
+}
+
+//--check-successors: every expansion also runs the old full-copy generator (every box, every direction,
+//player region flooded from scratch, same dead square and packing order cuts) and compares the sorted child sets
+bool CHECK_SUCCESSORS = false;
+
+int compare_levels(const void* a, const void* b) {
+	return memcmp(*(char* const*) a, *(char* const*) b, SIZE);
+}
+int reference_successors(char** list, struct gamestate* state) {
+	int i, d, entries = 0;
 	char* level = state->level;
-	for (i = 0; i < GROWTH_FACTOR; i++) list[i] = NULL;
-	int entries = 0;
+	int transit_box = (PACKING_ORDER && state->origin_side == FROM_LEFT_SIDE) ? find_transit_box(level) : -1;
 	for (i = 0; i < SIZE; i++) if (level[i] & BOX) for (d = 0; d < 4; d++) {
 		int after_box = i + DIRECTIONS[d];
-		int after_after_box = i + 2 * DIRECTIONS[d];
-		//after_box is player, after_after_box is empty space. pull the box
-		if (!(level[after_box] & WALL)) if (!(level[after_box] & BOX)) if (level[after_box] & PLAYER)
-			if (!(level[after_after_box] & WALL)) if (!(level[after_after_box] & BOX)) {
-				char* new_level = copy_level(level);
-				new_level[i] &= ~BOX;
-				new_level[after_box] |= BOX;
-				set_player_region(new_level, after_after_box);
-				struct gamestate* new_state = make_gamestate(new_level, state->origin_side);
-				bool already_found = false;
-				for (j = 0; j < entries && !already_found; j++) if (list[j] == new_state) already_found = true;
-				if (!already_found) list[entries++] = new_state;
-			}
+		int player;
+		if (state->origin_side == FROM_LEFT_SIDE) {
+			if (PACKING_ORDER && !packing_allows_push(i, transit_box)) break;
+			if (!(level[i - DIRECTIONS[d]] & PLAYER)) continue;
+			if (level[after_box] & (WALL | BOX) || PUSH_DEAD_SQUARES[after_box]) continue;
+			player = i;
+		} else {
+			if (!(level[after_box] & PLAYER)) continue;
+			if (level[after_box + DIRECTIONS[d]] & (WALL | BOX) || PULL_DEAD_SQUARES[after_box]) continue;
+			player = after_box + DIRECTIONS[d];
+		}
+		char* new_level = copy_level(level);
+		new_level[i] &= ~BOX;
+		new_level[after_box] |= BOX;
+		set_player_region(new_level, player);
+		list[entries++] = new_level;
+	}
+	return entries;
+}
+void check_successors(struct gamestate* state, struct move* moves, int n_moves) {
+	char** expected = (char**) malloc(sizeof(char*) * GROWTH_FACTOR);
+	char** found = (char**) malloc(sizeof(char*) * GROWTH_FACTOR);
+	int n_expected = reference_successors(expected, state);
+	int i, j;
+	bool mismatch = n_expected != n_moves;
+	for (i = 0; i < n_moves; i++) {
+		unsigned int hash = move_hash(&moves[i], mark_child_region(&REACHABILITY, state->level, moves[i].box_from, moves[i].box_to, moves[i].player));
+		found[i] = build_move_child(state->level, &moves[i]);
+		if (hash != level_hash(found[i])) mismatch = true;
+	}
+	//OG_PLAYER only says where the player stood, it isn't part of the position
+	for (i = 0; i < n_expected; i++) for (j = 0; j < SIZE; j++) expected[i][j] &= ~OG_PLAYER;
+	for (i = 0; i < n_moves; i++) for (j = 0; j < SIZE; j++) found[i][j] &= ~OG_PLAYER;
+	qsort(expected, n_expected, sizeof(char*), compare_levels);
+	qsort(found, n_moves, sizeof(char*), compare_levels);
+	for (i = 0; i < n_expected && i < n_moves && !mismatch; i++) if (!identical_levels(expected[i], found[i])) mismatch = true;
+	if (mismatch) {
+		printf("Successor check failed: %d moves, %d children from the old generator, expanding\n", n_moves, n_expected);
+		print_state(state);
+		exit(EXIT_FAILURE);
 	}
+	for (i = 0; i < n_expected; i++) free(expected[i]);
+	for (i = 0; i < n_moves; i++) free(found[i]);
+	free(expected);
+	free(found);
 }
 
-struct gamestate** HEAP;
-int HEAP_CAPACITY;
-int HEAP_MEMBERS;
-void setup_heap(int capacity) {
-	HEAP_CAPACITY = capacity;
-	HEAP = (struct gamestate**) malloc(sizeof(struct gamestate*) * HEAP_CAPACITY);
+//Each side of the search has its own frontier, a min-heap on priority
+struct heap {
+	struct gamestate** members;
+	int capacity;
+	int size;
+};
+struct heap LEFT_FRONTIER;
+struct heap RIGHT_FRONTIER;
+struct heap* frontier_of(char origin_side) {
+	if (origin_side == FROM_LEFT_SIDE) return &LEFT_FRONTIER;
+	return &RIGHT_FRONTIER;
+}
+void setup_heap(struct heap* heap, int capacity) {
+	heap->capacity = capacity;
+	heap->members = (struct gamestate**) malloc(sizeof(struct gamestate*) * heap->capacity);
 	int i;
-	for (i = 0; i < HEAP_CAPACITY; i++)
-		HEAP[i] = NULL;
-	HEAP_MEMBERS = 0;
+	for (i = 0; i < heap->capacity; i++)
+		heap->members[i] = NULL;
+	heap->size = 0;
 }
-void expand_heap_capacity() {
-	struct gamestate** new_heap = (struct gamestate**) malloc(sizeof(struct gamestate*) * HEAP_CAPACITY * 2);
+void expand_heap_capacity(struct heap* heap) {
+	struct gamestate** new_members = (struct gamestate**) malloc(sizeof(struct gamestate*) * heap->capacity * 2);
 	int i;
-	for (i = 0; i < HEAP_CAPACITY; i++) new_heap[i] = HEAP[i];
-	for (i = HEAP_CAPACITY; i < HEAP_CAPACITY*2; i++) new_heap[i] = NULL;
-	HEAP_CAPACITY *= 2;
-	free(HEAP);
-	HEAP = new_heap;
+	for (i = 0; i < heap->capacity; i++) new_members[i] = heap->members[i];
+	for (i = heap->capacity; i < heap->capacity*2; i++) new_members[i] = NULL;
+	heap->capacity *= 2;
+	free(heap->members);
+	heap->members = new_members;
+}
+void heap_swap(struct heap* heap, int a, int b) {
+	struct gamestate* temp = heap->members[a];
+	heap->members[a] = heap->members[b];
+	heap->members[b] = temp;
+	heap->members[a]->heap_index = a;
+	heap->members[b]->heap_index = b;
 }
-void sift_down(int index) {
+void sift_down(struct heap* heap, int index) {
 	int left = 2 * index + 1;
 	int right = 2 * index + 2;
 	int smallest = index;
 
-	if (left < HEAP_MEMBERS && HEAP[left]->f_score < HEAP[smallest]->f_score) {
+	if (left < heap->size && heap->members[left]->priority < heap->members[smallest]->priority) {
 		smallest = left;
 	}
-	if (right < HEAP_MEMBERS && HEAP[right]->f_score < HEAP[smallest]->f_score) {
+	if (right < heap->size && heap->members[right]->priority < heap->members[smallest]->priority) {
 		smallest = right;
 	}
 	if (smallest != index) {
-		struct gamestate* temp = HEAP[index];
-		HEAP[index] = HEAP[smallest];
-		HEAP[smallest] = temp;
-		sift_down(smallest);
+		heap_swap(heap, index, smallest);
+		sift_down(heap, smallest);
 	}
 }
-void sift_up(int index) {
+void sift_up(struct heap* heap, int index) {
 	int parent = (index - 1) / 2;
-	if (index > 0 && HEAP[index]->f_score < HEAP[parent]->f_score) {
-		struct gamestate* temp = HEAP[index];
-		HEAP[index] = HEAP[parent];
-		HEAP[parent] = temp;
-		sift_up(parent);
+	if (index > 0 && heap->members[index]->priority < heap->members[parent]->priority) {
+		heap_swap(heap, index, parent);
+		sift_up(heap, parent);
 	}
 }
-void add_to_heap(struct gamestate* state) {
+//Inserts the state, or repositions it if it is already in the frontier (its priority changed)
+//States that were already expanded get reopened, since the heuristic isn't consistent
+void add_to_heap(struct heap* heap, struct gamestate* state) {
 	if (state->f_score > (INT_MAX/2)-50) return;
-	state->ever_been_in_frontier = true;
-	if (HEAP_MEMBERS >= HEAP_CAPACITY) {
-		expand_heap_capacity();
+	if (state->heap_index >= 0) {
+		sift_up(heap, state->heap_index);
+		sift_down(heap, state->heap_index);
+		return;
+	}
+	if (heap->size >= heap->capacity) {
+		expand_heap_capacity(heap);
 	}
-	HEAP[HEAP_MEMBERS] = state;
-	HEAP_MEMBERS++;
-	sift_up(HEAP_MEMBERS - 1);
+	heap->members[heap->size] = state;
+	state->heap_index = heap->size;
+	heap->size++;
+	sift_up(heap, heap->size - 1);
 	//printf("added to heap, f score %d, from %c\n", state->f_score, (state->origin_side == FROM_LEFT_SIDE) ? 'L' : 'R');
 }
-struct gamestate* heap_pop() {
-	if (HEAP_MEMBERS == 0) return NULL;
-	struct gamestate* top = HEAP[0];
-	HEAP[0] = HEAP[HEAP_MEMBERS - 1];
-	HEAP_MEMBERS--;
-	sift_down(0);
+struct gamestate* heap_pop(struct heap* heap) {
+	if (heap->size == 0) return NULL;
+	struct gamestate* top = heap->members[0];
+	heap->size--;
+	if (heap->size) {
+		heap->members[0] = heap->members[heap->size];
+		heap->members[0]->heap_index = 0;
+		sift_down(heap, 0);
+	}
+	top->heap_index = -1;
 	return top;
 }
-void heap_update_new_f_score(struct gamestate* state) {
-	int i;
-	for (i = 0; i < HEAP_MEMBERS; i++) if (state == HEAP[i]) {
-		sift_up(i);
-		sift_down(i);
-		return;
-	}
+int heap_min_priority(struct heap* heap) {
+	if (heap->size == 0) return INT_MAX;
+	return heap->members[0]->priority;
 }
-void print_heap() {
+void print_heap(struct heap* heap) {
 	printf("======\n");
 	int i;
-	for (i = 0; i < HEAP_MEMBERS; i++) printf("%08X (f = %d)\n", HEAP[i], HEAP[i]->f_score);
+	for (i = 0; i < heap->size; i++) printf("%08X (f = %d, priority = %d)\n", heap->members[i], heap->members[i]->f_score, heap->members[i]->priority);
 	printf("======\n");
 }
 
+//MM priority: a state is not expanded before its g passes half of any solution it could be on
+int priority_of(int g_score, int h_score) {
+	int f = add(g_score, h_score);
+	if (f == INT_MAX) return INT_MAX;
+	if (2 * g_score > f) return 2 * g_score;
+	return f;
+}
+int mm_priority(struct gamestate* state) {
+	return priority_of(state->g_score, state->h_score);
+}
+
+//Best solution found so far: the cheapest pair of nodes, one from each side, for the same position
+int BEST_SOLUTION_LENGTH = INT_MAX;
+struct gamestate* BEST_MEET_LEFT = NULL;
+struct gamestate* BEST_MEET_RIGHT = NULL;
+void check_for_meeting(struct gamestate* state) {
+	char other_side = (state->origin_side == FROM_LEFT_SIDE) ? FROM_RIGHT_SIDE : FROM_LEFT_SIDE;
+	struct gamestate* other = find_gamestate(state->level, state->hash, other_side);
+	if (!other) return;
+	int length = add(state->g_score, other->g_score);
+	if (length >= BEST_SOLUTION_LENGTH) return;
+	BEST_SOLUTION_LENGTH = length;
+	BEST_MEET_LEFT = (state->origin_side == FROM_LEFT_SIDE) ? state : other;
+	BEST_MEET_RIGHT = (state->origin_side == FROM_LEFT_SIDE) ? other : state;
+}
+
+
+
+//Instrumentation, with --stats PREFIX: where boxes sit in expanded states (PREFIX_boxes.csv), f scores of expanded
+//states and of what is left in each frontier (PREFIX_f.csv), and the heuristics against the real number of pushes
+//at every position on the solution (PREFIX_path.csv)
+char* STATS_PREFIX = NULL;
+long long* STATS_BOX_COUNTS[2]; //expansions with a box on each square, from the left and right side
+long long* STATS_F_COUNTS[2]; //expansions at each f score
+int STATS_F_CAPACITY = 0;
+
+int side_index(char origin_side) {
+	return (origin_side == FROM_LEFT_SIDE) ? 0 : 1;
+}
+
+void setup_stats() {
+	int side;
+	for (side = 0; side < 2; side++) {
+		STATS_BOX_COUNTS[side] = (long long*) calloc(SIZE, sizeof(long long));
+		STATS_F_COUNTS[side] = NULL;
+	}
+}
+
+void grow_f_counts(long long** counts, int f, int* capacity) {
+	if (f < *capacity) return;
+	int new_capacity = (*capacity) ? *capacity : 64;
+	while (new_capacity <= f) new_capacity *= 2;
+	int side;
+	for (side = 0; side < 2; side++) {
+		counts[side] = (long long*) realloc(counts[side], sizeof(long long) * new_capacity);
+		memset(counts[side] + *capacity, 0, sizeof(long long) * (new_capacity - *capacity));
+	}
+	*capacity = new_capacity;
+}
+
+//Called for each state as it's expanded, once find_moves has filled EXPANDED_BOXES
+void record_expansion(struct gamestate* state) {
+	int side = side_index(state->origin_side), i;
+	for (i = 0; i < N_BOXES; i++) STATS_BOX_COUNTS[side][EXPANDED_BOXES[i]]++;
+	grow_f_counts(STATS_F_COUNTS, state->f_score, &STATS_F_CAPACITY);
+	STATS_F_COUNTS[side][state->f_score]++;
+}
+
+FILE* open_stats_file(char* suffix) {
+	char* path = (char*) malloc(strlen(STATS_PREFIX) + strlen(suffix) + 1);
+	sprintf(path, "%s%s", STATS_PREFIX, suffix);
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		printf("Couldn't write %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	free(path);
+	return file;
+}
+
+void write_stats() {
+	int i, side, f;
+	FILE* file = open_stats_file("_boxes.csv");
+	fprintf(file, "x,y,left,right\n");
+	for (i = 0; i < SIZE; i++) if (STATS_BOX_COUNTS[0][i] || STATS_BOX_COUNTS[1][i])
+		fprintf(file, "%d,%d,%lld,%lld\n", i % WIDTH, i / WIDTH, STATS_BOX_COUNTS[0][i], STATS_BOX_COUNTS[1][i]);
+	fclose(file);
+	
+	long long* open_counts[2] = {NULL, NULL};
+	int open_capacity = 0;
+	for (side = 0; side < 2; side++) {
+		struct heap* frontier = frontier_of(side ? FROM_RIGHT_SIDE : FROM_LEFT_SIDE);
+		for (i = 0; i < frontier->size; i++) {
+			grow_f_counts(open_counts, frontier->members[i]->f_score, &open_capacity);
+			open_counts[side][frontier->members[i]->f_score]++;
+		}
+	}
+	file = open_stats_file("_f.csv");
+	fprintf(file, "side,f,expanded,open\n");
+	for (side = 0; side < 2; side++) for (f = 0; f < STATS_F_CAPACITY || f < open_capacity; f++) {
+		long long expanded = (f < STATS_F_CAPACITY) ? STATS_F_COUNTS[side][f] : 0;
+		long long open = (f < open_capacity) ? open_counts[side][f] : 0;
+		if (expanded || open) fprintf(file, "%c,%d,%lld,%lld\n", side ? FROM_RIGHT_SIDE : FROM_LEFT_SIDE, f, expanded, open);
+	}
+	fclose(file);
+	free(open_counts[0]);
+	free(open_counts[1]);
+	
+	//An optimal solution's positions are exactly pushes_done from the start and pushes_left from the goal.
+	//One found keeping to the packing order may not be optimal, and then optimal is 0 on every row
+	file = open_stats_file("_path.csv");
+	fprintf(file, "pushes_done,pushes_left,h_to_goal,h_to_start,optimal\n");
+	if (BEST_MEET_LEFT) {
+		struct gamestate** path = (struct gamestate**) malloc(sizeof(struct gamestate*) * (BEST_SOLUTION_LENGTH + 1));
+		struct gamestate* walker;
+		int length = 0;
+		for (walker = BEST_MEET_LEFT; walker; walker = walker->point_back) path[length++] = walker;
+		for (i = 0; i < length / 2; i++) {
+			walker = path[i];
+			path[i] = path[length - 1 - i];
+			path[length - 1 - i] = walker;
+		}
+		for (walker = BEST_MEET_RIGHT->point_back; walker; walker = walker->point_back) path[length++] = walker;
+		for (i = 0; i < length; i++)
+			fprintf(file, "%d,%d,%d,%d,%d\n", i, BEST_SOLUTION_LENGTH - i, level_heuristic(path[i]->level, FROM_LEFT_SIDE), level_heuristic(path[i]->level, FROM_RIGHT_SIDE), !PACKING_ORDER);
+		free(path);
+	}
+	fclose(file);
+}
+
+//Forget every state, the frontiers, the best meeting and the stats, to search again from scratch
+void reset_search() {
+	int i, side;
+	for (i = 0; i < GAMESTATE_HASH_TABLE_SIZE; i++) while (GAMESTATE_HASH_TABLE[i]) {
+		struct gamestate* next = GAMESTATE_HASH_TABLE[i]->next_in_hash_table;
+		free(GAMESTATE_HASH_TABLE[i]->level);
+		free(GAMESTATE_HASH_TABLE[i]);
+		GAMESTATE_HASH_TABLE[i] = next;
+	}
+	STATES_STORED = 0;
+	LEFT_FRONTIER.size = 0;
+	RIGHT_FRONTIER.size = 0;
+	BEST_MEET_LEFT = NULL;
+	BEST_MEET_RIGHT = NULL;
+	BEST_SOLUTION_LENGTH = INT_MAX;
+	if (STATS_PREFIX) for (side = 0; side < 2; side++) {
+		memset(STATS_BOX_COUNTS[side], 0, sizeof(long long) * SIZE);
+		if (STATS_F_CAPACITY) memset(STATS_F_COUNTS[side], 0, sizeof(long long) * STATS_F_CAPACITY);
+	}
+}
+
 
 
 int* PATHFIND_QUEUE;
@@ -420,32 +924,265 @@ void reconstruct_solution_right(struct gamestate* state) {
 }
 
 
+#include "collection.h"
+
+
+//Solution verifier: replays solutions against their levels, in bulk and across all cores
+//Input is levels each followed by a line of LURD moves, which is what this program prints, so outputs can be concatenated
+struct solution_pair {
+	long long board_offset;
+	long long solution_offset;
+	int board_length;
+	int solution_length;
+};
+
+struct verify_result {
+	bool legal;
+	bool solved;
+	int moves;
+	int pushes;
+	int bad_move; //index of the first illegal move
+	int board_problem; //BOARD_OK, or why the board couldn't be checked at all
+};
+#define BOARD_OK (0)
+#define BOARD_TOO_LARGE (1)
+#define BOARD_NO_PLAYER (2)
+
+char* VERIFY_DATA;
+struct solution_pair* VERIFY_PAIRS;
+int N_VERIFY_PAIRS;
+struct verify_result* VERIFY_RESULTS;
+int NEXT_VERIFY_PAIR = 0;
+#define VERIFY_BATCH_SIZE (256)
+
+#include "processors.h"
+
+bool is_solution_line(char* line, int length) {
+	int i;
+	if (length == 0) return false;
+	for (i = 0; i < length; i++) if (!strchr("lurdLURD", line[i])) return false;
+	return true;
+}
+
+//Pairs each board with the first line of moves after it, before the next board
+void find_solution_pairs(long long size) {
+	int capacity = 1024;
+	VERIFY_PAIRS = (struct solution_pair*) malloc(sizeof(struct solution_pair) * capacity);
+	N_VERIFY_PAIRS = 0;
+	long long board_offset = -1;
+	int board_length = 0;
+	bool in_board = false;
+	long long position = 0;
+	while (position < size) {
+		char* line = VERIFY_DATA + position;
+		long long end = position;
+		while (end < size && VERIFY_DATA[end] != '\n') end++;
+		int length = end - position;
+		while (length && line[length-1] == '\r') length--;
+		if (is_board_line(line, length)) {
+			if (!in_board) board_offset = position;
+			board_length = end - board_offset;
+			in_board = true;
+		} else {
+			in_board = false;
+			if (board_offset >= 0 && is_solution_line(line, length)) {
+				if (N_VERIFY_PAIRS == capacity) {
+					capacity *= 2;
+					VERIFY_PAIRS = (struct solution_pair*) realloc(VERIFY_PAIRS, sizeof(struct solution_pair) * capacity);
+				}
+				struct solution_pair* pair = &VERIFY_PAIRS[N_VERIFY_PAIRS++];
+				pair->board_offset = board_offset;
+				pair->board_length = board_length;
+				pair->solution_offset = position;
+				pair->solution_length = length;
+				board_offset = -1;
+			}
+		}
+		position = end + 1;
+	}
+}
+
+//Works on its own copy of the board, sized to the level, without touching any of the solver's globals
+void verify_solution(struct solution_pair* pair, struct verify_result* result, char* board) {
+	int i, x = 0, y = 0, width = 0, height = 1;
+	bool has_player = false;
+	char* text = VERIFY_DATA + pair->board_offset;
+	for (i = 0; i < pair->board_length; i++) {
+		if (text[i] == '\n') {
+			if (x > width) width = x;
+			x = 0;
+			height++;
+		} else if (text[i] != '\r') x++;
+		if (text[i] == '@' || text[i] == '+') has_player = true;
+	}
+	if (x > width) width = x;
+	result->legal = result->solved = false;
+	result->moves = pair->solution_length;
+	result->pushes = 0;
+	result->bad_move = -1;
+	result->board_problem = BOARD_OK;
+	//ragged rows get padded out to the widest, so that's what has to fit in board
+	if ((long long) width * height > MAX_LEVEL_SIZE) result->board_problem = BOARD_TOO_LARGE;
+	else if (!has_player) result->board_problem = BOARD_NO_PLAYER;
+	if (result->board_problem != BOARD_OK) return;
+	int player = -1, boxes_off_goals = 0;
+	x = y = 0;
+	for (i = 0; i < pair->board_length; i++) {
+		if (text[i] == '\n') {
+			while (x < width) board[y*width + x++] = EMPTY;
+			x = 0;
+			y++;
+			continue;
+		}
+		if (text[i] == '\r') continue;
+		char cell = sok_to_native(text[i]);
+		if (cell & PLAYER) player = y*width + x;
+		cell &= ~PLAYER;
+		if ((cell & BOX) && !(cell & GOAL)) boxes_off_goals++;
+		board[y*width + x++] = cell;
+	}
+	while (x < width) board[y*width + x++] = EMPTY;
+	int size = (y + 1) * width;
+	
+	int directions[4] = {-1, -width, 1, width};
+	char* moves = VERIFY_DATA + pair->solution_offset;
+	result->legal = true;
+	for (i = 0; i < pair->solution_length && player >= 0; i++) {
+		int d;
+		bool push = (moves[i] >= 'A' && moves[i] <= 'Z');
+		for (d = 0; d < 4; d++) if (LURD[d] == moves[i] || LURD[d] + 'a' - 'A' == moves[i]) break;
+		int next = player + directions[d];
+		if (next < 0 || next >= size || (board[next] & WALL) || (d % 2 == 0 && next / width != player / width)) break;
+		if (board[next] & BOX) {
+			int after = next + directions[d];
+			if (!push || after < 0 || after >= size || (board[after] & (WALL | BOX))) break;
+			if (d % 2 == 0 && after / width != next / width) break;
+			board[next] &= ~BOX;
+			board[after] |= BOX;
+			if (!(board[next] & GOAL)) boxes_off_goals--;
+			if (!(board[after] & GOAL)) boxes_off_goals++;
+			result->pushes++;
+		} else if (push) break;
+		player = next;
+	}
+	if (i < pair->solution_length) {
+		result->legal = false;
+		result->bad_move = i;
+	}
+	result->solved = result->legal && boxes_off_goals == 0;
+}
+
+void* run_verifier(void* argument) {
+	(void) argument;
+	char* board = (char*) malloc(sizeof(char) * MAX_LEVEL_SIZE);
+	while (true) {
+		int start = __sync_fetch_and_add(&NEXT_VERIFY_PAIR, VERIFY_BATCH_SIZE);
+		if (start >= N_VERIFY_PAIRS) break;
+		int end = start + VERIFY_BATCH_SIZE;
+		if (end > N_VERIFY_PAIRS) end = N_VERIFY_PAIRS;
+		int i;
+		for (i = start; i < end; i++) verify_solution(&VERIFY_PAIRS[i], &VERIFY_RESULTS[i], board);
+	}
+	free(board);
+	return NULL;
+}
+
+void verify_solutions(char* path, int n_threads) {
+	int i;
+	long long size;
+	VERIFY_DATA = map_file(path, &size, NULL);
+	if (!VERIFY_DATA) {
+		printf("Couldn't map %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	clock_t begin_time = clock();
+	find_solution_pairs(size);
+	VERIFY_RESULTS = (struct verify_result*) malloc(sizeof(struct verify_result) * (N_VERIFY_PAIRS + 1));
+	pthread_t* threads = (pthread_t*) malloc(sizeof(pthread_t) * n_threads);
+	for (i = 0; i < n_threads; i++) pthread_create(&threads[i], NULL, run_verifier, NULL);
+	for (i = 0; i < n_threads; i++) pthread_join(threads[i], NULL);
+	clock_t end_time = clock();
+	
+	long long total_moves = 0, total_pushes = 0;
+	int failures = 0;
+	for (i = 0; i < N_VERIFY_PAIRS; i++) {
+		struct verify_result* result = &VERIFY_RESULTS[i];
+		total_moves += result->moves;
+		total_pushes += result->pushes;
+		if (result->solved) continue;
+		failures++;
+		if (result->board_problem == BOARD_TOO_LARGE) printf("Solution #%d: malformed board, too large\n", i + 1);
+		else if (result->board_problem == BOARD_NO_PLAYER) printf("Solution #%d: malformed board, no player\n", i + 1);
+		else if (!result->legal) printf("Solution #%d: illegal move %d ('%c')\n", i + 1, result->bad_move + 1, VERIFY_DATA[VERIFY_PAIRS[i].solution_offset + result->bad_move]);
+		else printf("Solution #%d: level isn't solved at the end\n", i + 1);
+	}
+	double seconds = (double)(end_time - begin_time) / CLOCKS_PER_SEC;
+	printf("%d solutions, %d valid, %d invalid\n", N_VERIFY_PAIRS, N_VERIFY_PAIRS - failures, failures);
+	printf("%lld moves, %lld pushes", total_moves, total_pushes);
+	if (seconds > 0) printf(" (%.0f moves per CPU second)", total_moves / seconds);
+	printf("\n");
+	exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
 
 
 
-int main() {
+
+int main(int nargs, char** arglist) {
 	int i, j, k;
 	
-	//Read sok into INPUT_SOK
-	INPUT_SOK = (char*) malloc(sizeof(char) * MAX_LEVEL_SIZE);
-	int current_row_width = 0;
-	char c;
-	i = 0;
-	WIDTH = 0;
-	HEIGHT = 0;
-	do {
-		c = getchar();
-		INPUT_SOK[i++] = c;
-		if (c == '\n') {
-			if (current_row_width > WIDTH)
-				WIDTH = current_row_width;
-			current_row_width = 0;
-			HEIGHT++;
+	char* collection_path = NULL;
+	int level_number = 1;
+	char* level_title = NULL;
+	char* verify_path = NULL;
+	int n_threads = count_processors();
+	for (i = 1; i < nargs; i++) {
+		if (!strcmp(arglist[i], "--partial-expansion")) PARTIAL_EXPANSION = true;
+		else if (!strcmp(arglist[i], "--packing-order")) PACKING_ORDER = true;
+		else if (!strcmp(arglist[i], "--check-successors")) CHECK_SUCCESSORS = true;
+		else if (!strcmp(arglist[i], "--stats") && i + 1 < nargs) STATS_PREFIX = arglist[++i];
+		else if (!strcmp(arglist[i], "--collection") && i + 1 < nargs) collection_path = arglist[++i];
+		else if (!strcmp(arglist[i], "--level") && i + 1 < nargs) level_number = atoi(arglist[++i]);
+		else if (!strcmp(arglist[i], "--title") && i + 1 < nargs) level_title = arglist[++i];
+		else if (!strcmp(arglist[i], "--verify") && i + 1 < nargs) verify_path = arglist[++i];
+		else if (!strcmp(arglist[i], "--threads") && i + 1 < nargs) n_threads = atoi(arglist[++i]);
+		else {
+			printf("Unknown option %s\n", arglist[i]);
+			exit(EXIT_FAILURE);
 		}
-		else current_row_width++;
-	} while (c != EOF && c != '\0');
-	if (current_row_width > WIDTH) WIDTH = current_row_width;
-	if (current_row_width) HEIGHT++;
+	}
+	if (verify_path) verify_solutions(verify_path, (n_threads > 0) ? n_threads : 1);
+	
+	//Read sok into INPUT_SOK, or point it at one level of a collection
+	int input_length;
+	char c;
+	if (collection_path) {
+		open_collection(collection_path);
+		struct collection_entry* entry = &COLLECTION_INDEX[find_collection_level(level_number, level_title)];
+		INPUT_SOK = COLLECTION_DATA + entry->board_offset;
+		input_length = entry->board_length;
+		measure_board(INPUT_SOK, input_length);
+	} else {
+		INPUT_SOK = (char*) malloc(sizeof(char) * MAX_LEVEL_SIZE);
+		int current_row_width = 0;
+		i = 0;
+		WIDTH = 0;
+		HEIGHT = 0;
+		do {
+			c = getchar();
+			INPUT_SOK[i++] = c;
+			if (c == '\n') {
+				if (current_row_width > WIDTH)
+					WIDTH = current_row_width;
+				current_row_width = 0;
+				HEIGHT++;
+			}
+			else current_row_width++;
+		} while (c != EOF && c != '\0');
+		if (current_row_width > WIDTH) WIDTH = current_row_width;
+		if (current_row_width) HEIGHT++;
+		input_length = i;
+	}
 	DIRECTIONS[0] = LEFT = -1;
 	DIRECTIONS[1] = UP = -WIDTH;
 	DIRECTIONS[2] = RIGHT = 1;
@@ -456,12 +1193,13 @@ int main() {
 	for (i = 0; i < SIZE; i++) start_level[i] = 0;
 	N_BOXES = N_GOALS = 0;
 	j = 0;
-	for (i = 0; i < SIZE;) {
+	for (i = 0; i < SIZE && j < input_length;) {
 		c = INPUT_SOK[j++];
 		if (c == '\n') {
 			while (i%WIDTH) i++;
 			continue;
 		}
+		if (c == '\r') continue;
 		if (c == EOF || c == '\0') break;
 		start_level[i] = sok_to_native(c);
 		if (start_level[i] & BOX) N_BOXES++;
@@ -472,7 +1210,7 @@ int main() {
 		printf("Found %d boxes and %d goals\n", N_BOXES, N_GOALS);
 		exit(EXIT_FAILURE);
 	}
-	free(INPUT_SOK);
+	if (!collection_path) free(INPUT_SOK);
 	
 	clock_t begin_time = clock();
 	clock_t end_time;
@@ -515,106 +1253,163 @@ int main() {
 		if (start_level[i] & PLAYER) INITIAL_PLAYER_POSITION = i;
 	}
 	
+	if (PACKING_ORDER) compute_packing_order(start_level);
 	set_player_region(start_level, INITIAL_PLAYER_POSITION);
 	
-	//Create start state
-	struct gamestate* start_state = make_gamestate(start_level, FROM_LEFT_SIDE);
-	start_state->g_score = 0;
-	start_state->f_score = start_state->h_score;
+	setup_heap(&LEFT_FRONTIER, 1024);
+	setup_heap(&RIGHT_FRONTIER, 1024);
+	struct move* moves = (struct move*) malloc(sizeof(struct move) * GROWTH_FACTOR);
+	setup_move_structures();
+	if (STATS_PREFIX) setup_stats();
 	
-	//Create end states
-	char* end_level_template = copy_level(start_level);
-	for (i = 0; i < SIZE; i++) if (end_level_template[i] & BOX) end_level_template[i] &= ~BOX;
-	for (i = 0; i < SIZE; i++) if (end_level_template[i] & GOAL) end_level_template[i] |= BOX;
-	struct gamestate** end_states = (struct gamestate**) malloc(sizeof(struct gamestate**) * GROWTH_FACTOR);
-	int end_states_count = 0;
-	for (j = 0; j < GROWTH_FACTOR; j++) end_states[j] = NULL;
-	for (i = 0; i < SIZE; i++) if (end_level_template[i] & BOX) for (k = 0; k < 4; k++) {
-		int player_position = i + DIRECTIONS[k];
-		if (end_level_template[player_position] & BOX) continue;
-		if (end_level_template[player_position] & WALL) continue;
-		char* new_level = copy_level(end_level_template);
-		set_player_region(new_level, player_position);
-		struct gamestate* an_end_state = make_gamestate(new_level, FROM_RIGHT_SIDE);
-		//make sure this isn't an end state we already considered
-		bool already_considered = false;
-		for (j = 0; j < end_states_count && !already_considered; j++)
-			if (end_states[j] == an_end_state) {
-				already_considered = true;
+	//The packing order isn't admissible and can cut off every solution, so then the search starts over without it
+	//Expansions are counted across both searches
+	unsigned long long int iterations_ran = 0;
+	struct gamestate* start_state;
+	while (true) {
+		//Create start state
+		start_state = make_gamestate(copy_level(start_level), FROM_LEFT_SIDE);
+		start_state->g_score = 0;
+		start_state->f_score = start_state->h_score;
+		
+		//Create end states
+		char* end_level_template = copy_level(start_level);
+		for (i = 0; i < SIZE; i++) if (end_level_template[i] & BOX) end_level_template[i] &= ~BOX;
+		for (i = 0; i < SIZE; i++) if (end_level_template[i] & GOAL) end_level_template[i] |= BOX;
+		struct gamestate** end_states = (struct gamestate**) malloc(sizeof(struct gamestate**) * GROWTH_FACTOR);
+		int end_states_count = 0;
+		for (j = 0; j < GROWTH_FACTOR; j++) end_states[j] = NULL;
+		for (i = 0; i < SIZE; i++) if (end_level_template[i] & BOX) for (k = 0; k < 4; k++) {
+			//the last push can't have filled an area goal before its turn
+			if (PACKING_ORDER && GOAL_AREA[i] >= 0 && PACKING_RANK[i] != AREA_SIZE[GOAL_AREA[i]]) break;
+			int player_position = i + DIRECTIONS[k];
+			if (end_level_template[player_position] & BOX) continue;
+			if (end_level_template[player_position] & WALL) continue;
+			char* new_level = copy_level(end_level_template);
+			set_player_region(new_level, player_position);
+			struct gamestate* an_end_state = make_gamestate(new_level, FROM_RIGHT_SIDE);
+			//make sure this isn't an end state we already considered
+			bool already_considered = false;
+			for (j = 0; j < end_states_count && !already_considered; j++)
+				if (end_states[j] == an_end_state) {
+					already_considered = true;
+				}
+			if (!already_considered) {
+				end_states[end_states_count] = an_end_state;
+				an_end_state->g_score = 0;
+				an_end_state->f_score = an_end_state->h_score;
+				end_states_count++;
+				//print_state(an_end_state);
 			}
-		if (!already_considered) {
-			end_states[end_states_count] = an_end_state;
-			an_end_state->g_score = 0;
-			an_end_state->f_score = an_end_state->h_score;
-			end_states_count++;
-			//print_state(an_end_state);
 		}
-	}
-	free(end_level_template);
-	
-	//Prepare heap
-	setup_heap(1024);
-	add_to_heap(start_state);
-	for (i = 0; i < end_states_count; i++) add_to_heap(end_states[i]);
-	if (end_states_count == 0) {
-		printf("Couldn't create ending states\n");
-		exit(EXIT_FAILURE);
-	}
-	if (HEAP_MEMBERS <= 1) {
-		printf("Heap is empty for some reason\n");
-		exit(EXIT_FAILURE);
-	}
-	
-	struct gamestate** neighbors = (struct gamestate**) malloc(sizeof(struct gamestate*) * GROWTH_FACTOR);
-	
-	//A*, from both sides
-	unsigned long long int iterations_ran = 0;
-	while (HEAP_MEMBERS) {
-		//print_heap();
-		struct gamestate* pick = heap_pop();
-		iterations_ran++;
-		if (iterations_ran%1000000 == 0) {
-			end_time = clock();
-			printf("Checked %d million positions (%d s)\n", iterations_ran/1000000, (int)((double)(end_time - begin_time) / CLOCKS_PER_SEC));
+		free(end_level_template);
+		
+		//Prepare frontiers
+		start_state->priority = mm_priority(start_state);
+		add_to_heap(&LEFT_FRONTIER, start_state);
+		check_for_meeting(start_state);
+		for (i = 0; i < end_states_count; i++) {
+			end_states[i]->priority = mm_priority(end_states[i]);
+			add_to_heap(&RIGHT_FRONTIER, end_states[i]);
+			check_for_meeting(end_states[i]);
+		}
+		free(end_states);
+		if (end_states_count == 0) {
+			printf("Couldn't create ending states\n");
+			exit(EXIT_FAILURE);
 		}
-		//printf("Heap has %d members, chose something where f_score = %d\n", HEAP_MEMBERS, pick->f_score);
-		//printf("\n\nPick\n");
-		//print_state(pick);
-		//printf("%c", pick->origin_side);
+		if (LEFT_FRONTIER.size == 0 || RIGHT_FRONTIER.size == 0) {
+			printf("Heap is empty for some reason\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		//Bidirectional A* with MM priorities, from both sides
+		//The smaller of the two frontier minimums is a lower bound on any solution not found yet,
+		//so once the best meeting found is no longer than it, that meeting is optimal
+		while (LEFT_FRONTIER.size && RIGHT_FRONTIER.size) {
+			int left_minimum = heap_min_priority(&LEFT_FRONTIER);
+			int right_minimum = heap_min_priority(&RIGHT_FRONTIER);
+			int lower_bound = (left_minimum < right_minimum) ? left_minimum : right_minimum;
+			if (BEST_SOLUTION_LENGTH <= lower_bound) break;
 		
-		if (pick->origin_side == FROM_LEFT_SIDE) find_post_states(neighbors, pick);
-		if (pick->origin_side == FROM_RIGHT_SIDE) find_pre_states(neighbors, pick);
+			//Expand the side holding the lower bound; when both do, the one with the smaller frontier
+			struct heap* frontier;
+			if (left_minimum < right_minimum) frontier = &LEFT_FRONTIER;
+			else if (right_minimum < left_minimum) frontier = &RIGHT_FRONTIER;
+			else frontier = (LEFT_FRONTIER.size <= RIGHT_FRONTIER.size) ? &LEFT_FRONTIER : &RIGHT_FRONTIER;
 		
-		for (i = 0; i < GROWTH_FACTOR && neighbors[i]; i++) {
-			struct gamestate* neighbor = neighbors[i];
-			if (neighbor->origin_side != pick->origin_side) {
-				setup_pathfinding_structures();
-				struct gamestate* towards_left = (pick->origin_side == FROM_LEFT_SIDE) ? pick : neighbor;
-				struct gamestate* towards_right = (pick->origin_side == FROM_LEFT_SIDE) ? neighbor : pick;
-				print_level(start_state->level);
-				reconstruct_solution_left(towards_left);
-				reconstruct_solution_make_transition(towards_left, towards_right);
-				reconstruct_solution_right(towards_right);
-				printf("\n");
+			//print_heap(frontier);
+			struct gamestate* pick = heap_pop(frontier);
+			iterations_ran++;
+			if (iterations_ran%1000000 == 0) {
 				end_time = clock();
-				printf("(%d s)\n", (int)((double)(end_time - begin_time) / CLOCKS_PER_SEC));
-				exit(EXIT_SUCCESS);
+				printf("Checked %d million positions (%d s)\n", iterations_ran/1000000, (int)((double)(end_time - begin_time) / CLOCKS_PER_SEC));
 			}
-			int possible_g_score = pick->g_score + 1;
-			if (possible_g_score < neighbor->g_score) {
+			//printf("Frontier has %d members, chose something where f_score = %d\n", frontier->size, pick->f_score);
+			//printf("\n\nPick\n");
+			//print_state(pick);
+			//printf("%c", pick->origin_side);
+		
+			int n_moves = find_moves(moves, pick);
+			if (CHECK_SUCCESSORS) check_successors(pick, moves, n_moves);
+			if (STATS_PREFIX) record_expansion(pick);
+		
+			int held_back_priority = INT_MAX; //best priority among children partial expansion didn't store
+			for (i = 0; i < n_moves; i++) {
+				int possible_g_score = pick->g_score + 1;
+				if (PARTIAL_EXPANSION && 2 * possible_g_score > pick->priority) {
+					//Held back without even looking at the heuristic, priority can't be below 2g
+					if (2 * possible_g_score < held_back_priority) held_back_priority = 2 * possible_g_score;
+					continue;
+				}
+				unsigned int hash = move_hash(&moves[i], mark_child_region(&REACHABILITY, pick->level, moves[i].box_from, moves[i].box_to, moves[i].player));
+				struct gamestate* neighbor = find_move_child(pick->level, &moves[i], hash, pick->origin_side);
+				if (neighbor && possible_g_score >= neighbor->g_score) continue;
+				int h_score = neighbor ? neighbor->h_score : move_heuristic(&moves[i], pick->origin_side);
+				if (PARTIAL_EXPANSION) {
+					int neighbor_priority = priority_of(possible_g_score, h_score);
+					if (neighbor_priority > pick->priority) {
+						if (neighbor_priority < held_back_priority) held_back_priority = neighbor_priority;
+						continue;
+					}
+				}
+				if (!neighbor) neighbor = insert_gamestate(build_move_child(pick->level, &moves[i]), hash, h_score, pick->origin_side);
 				neighbor->point_back = pick;
 				neighbor->g_score = possible_g_score;
-				neighbor->f_score = possible_g_score + neighbor->h_score;
-				if (neighbor->ever_been_in_frontier) {
-					heap_update_new_f_score(neighbor);
-				} else {
-					add_to_heap(neighbor);
-				}
+				neighbor->f_score = add(possible_g_score, neighbor->h_score);
+				neighbor->priority = mm_priority(neighbor);
+				add_to_heap(frontier, neighbor);
+				check_for_meeting(neighbor);
+			}
+			if (held_back_priority != INT_MAX) {
+				pick->priority = held_back_priority;
+				add_to_heap(frontier, pick);
 			}
 		}
+		if (BEST_MEET_LEFT || !PACKING_ORDER) break;
+		printf("No solution keeps to the packing order, searching again without it\n");
+		PACKING_ORDER = false;
+		reset_search();
 	}
-	printf("Search failed\n");
-	exit(EXIT_FAILURE);
+	if (!BEST_MEET_LEFT) {
+		printf("Search failed\n");
+		if (STATS_PREFIX) write_stats();
+		exit(EXIT_FAILURE);
+	}
+	
+	setup_pathfinding_structures();
+	print_level(start_state->level);
+	reconstruct_solution_left(BEST_MEET_LEFT);
+	//Both meeting nodes share boxes and player region, so the player only has to walk between them
+	pathfind_on_map(BEST_MEET_LEFT->level, find_og_player(BEST_MEET_LEFT->level), find_og_player(BEST_MEET_RIGHT->level));
+	reconstruct_solution_right(BEST_MEET_RIGHT);
+	printf("\n");
+	if (PACKING_ORDER) printf("Kept to the packing order, so this solution may not be optimal\n");
+	if (STATS_PREFIX) write_stats();
+	end_time = clock();
+	printf("%llu expansions, %d states stored, %d ms\n", iterations_ran, STATES_STORED, (int)((double)(end_time - begin_time) * 1000 / CLOCKS_PER_SEC));
+	printf("(%d s)\n", (int)((double)(end_time - begin_time) / CLOCKS_PER_SEC));
+	exit(EXIT_SUCCESS);
 }
 
 /*